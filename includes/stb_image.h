@@ -238,6 +238,13 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On top of SSE2 there is an AVX2 tier (IDCT, 2x2 chroma upsampling and
+// YCbCr->RGB/RGBA, 16 pixels at a time), also picked by a run-time test.
+// It produces the same bytes as the SSE2 and C kernels. Define STBI_NO_AVX2
+// to leave it out. stbi_jpeg_simd_limit() caps the tier the decoder may use,
+// which is mostly useful for benchmarking the tiers against each other; it is
+// not thread safe, so don't call it while any decode is running.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -491,6 +498,17 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// JPEG kernel tiers: 0 = C, 1 = SSE2 (or NEON), 2 = AVX2. decoders use the best
+// tier the CPU supports but no higher than max_tier (default 2). returns the tier
+// decoders will actually use. meant for benchmarks: the limit is a plain process
+// wide global that every decode reads without locking, so only call this while
+// no other thread is decoding
+STBIDEF int stbi_jpeg_simd_limit(int max_tier);
+
+// the same for the PNG row filters: 0 = C, 1 = SSE2 (default 1), with the same
+// rule about other threads
+STBIDEF int stbi_png_simd_limit(int max_tier);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -610,12 +628,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -717,7 +737,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -728,7 +748,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -739,6 +759,38 @@ static int stbi__sse2_available(void)
 #endif
 
 #endif
+
+// AVX2 kernels are compiled for AVX2 function by function, the rest of the
+// file is still plain SSE2 and they only run after a run-time check
+#if !defined(STBI_NO_JPEG) && !defined(STBI_NO_AVX2) && \
+    (defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1800))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_FN
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,0);
+   if (info[0] < 7) return 0;
+   __cpuid(info,1);
+   // AVX and OSXSAVE, then the OS has to save the ymm registers
+   if ((info[2] & (3 << 27)) != (3 << 27)) return 0;
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#define STBI__AVX2_FN __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   // also checks that the OS saves the ymm registers
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif // STBI_AVX2
+
 #endif
 
 // ARM NEON
@@ -1872,7 +1924,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 #ifndef STBI_NO_JPEG
 
 // huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+#define FAST_BITS   10 // larger handles more cases; smaller stomps less cache (10: most AC codes plus their magnitude)
 
 typedef struct
 {
@@ -1892,6 +1944,7 @@ typedef struct
    stbi__huffman huff_ac[4];
    stbi__uint16 dequant[4][64];
    stbi__int16 fast_ac[4][1 << FAST_BITS];
+   stbi__int32 fast_ac_eob[4][1 << FAST_BITS]; // baseline only, see stbi__build_fast_ac_eob
 
 // sizes for components, interleaved MCUs
    int img_h_max, img_v_max;
@@ -2008,8 +2061,65 @@ static void stbi__build_fast_ac(stbi__int16 *fast_ac, stbi__huffman *h)
    }
 }
 
+// the baseline version of fast_ac: one lookup can decode two symbols, a
+// coefficient and the end-of-block code right after it (which ends most
+// blocks), and the lone EOB and ZRL codes are in the table too.
+//   bits 0-4 coefficient bits (huffman code + magnitude, 0 for a lone EOB)
+//   bits 5-8 run, bits 10-14 EOB code bits after them (0 if none)
+//   bits 16-31 coefficient value, no +-127 limit
+static void stbi__build_fast_ac_eob(stbi__int32 *fast_ac_eob, stbi__huffman *h)
+{
+   int i, eob_len = 0, eob_code = 0;
+
+   for (i=0; h->size[i]; ++i)
+      if (h->values[i] == 0 && h->size[i] <= FAST_BITS) {
+         eob_len = h->size[i];
+         eob_code = h->code[i];
+      }
+
+   for (i=0; i < (1 << FAST_BITS); ++i) {
+      stbi_uc fast = h->fast[i];
+      fast_ac_eob[i] = 0;
+      if (fast < 255) {
+         int rs = h->values[fast];
+         int run = (rs >> 4) & 15;
+         int magbits = rs & 15;
+         int len = h->size[fast];
+
+         if (rs == 0x00) {
+            fast_ac_eob[i] = len << 10; // EOB
+         } else if (rs == 0xf0) {
+            fast_ac_eob[i] = (15 << 5) + len; // ZRL: 15 zeros, then a zero coefficient
+         } else if (magbits && len + magbits <= FAST_BITS) {
+            int used = len + magbits;
+            int k = ((i << len) & ((1 << FAST_BITS) - 1)) >> (FAST_BITS - magbits);
+            int m = 1 << (magbits - 1);
+            if (k < m) k += (~0U << magbits) + 1;
+            fast_ac_eob[i] = (stbi__int32) (((stbi__uint32) k << 16) + (run << 5) + used);
+
+            // the code after the coefficient is the block's end
+            if (eob_len && used + eob_len <= FAST_BITS &&
+                (((i << used) & ((1 << FAST_BITS) - 1)) >> (FAST_BITS - eob_len)) == eob_code)
+               fast_ac_eob[i] += eob_len << 10;
+         }
+      }
+   }
+}
+
 static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
 {
+   // whole bytes straight from memory until a 0xff (marker or stuffed byte)
+   // needs looking at, or the buffer needs refilling from the callbacks
+   if (!j->nomore) {
+      stbi_uc *p = j->s->img_buffer, *end = j->s->img_buffer_end;
+      while (j->code_bits <= 24 && p < end && *p != 0xff) {
+         j->code_buffer |= (unsigned int) *p++ << (24 - j->code_bits);
+         j->code_bits += 8;
+      }
+      j->s->img_buffer = p;
+      if (j->code_bits > 24) return;
+   }
+
    do {
       unsigned int b = j->nomore ? 0 : stbi__get8(j->s);
       if (b == 0xff) {
@@ -2139,14 +2249,14 @@ static const stbi_uc stbi__jpeg_dezigzag[64+15] =
 };
 
 // decode one 64-entry block--
-static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__huffman *hac, stbi__int16 *fac, int b, stbi__uint16 *dequant)
+static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__huffman *hac, stbi__int32 *fac, int b, stbi__uint16 *dequant)
 {
    int diff,dc,k;
    int t;
 
    if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
    t = stbi__jpeg_huff_decode(j, hdc);
-   if (t < 0) return stbi__err("bad huffman code","Corrupt JPEG");
+   if (t < 0 || t > 15) return stbi__err("bad huffman code","Corrupt JPEG"); // a DC size past 15 would read past stbi__jbias
 
    // 0 all the ac values now so we can do it 32-bits at a time
    memset(data,0,64*sizeof(data[0]));
@@ -2165,13 +2275,27 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
       c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
       r = fac[c];
       if (r) { // fast-AC path
-         k += (r >> 4) & 15; // run
-         s = r & 15; // combined length
+         s = r & 31; // combined length
+         if (s) {
+            k += (r >> 5) & 15; // run
+            // decode into unzigzag'd location
+            zig = stbi__jpeg_dezigzag[k++];
+            data[zig] = (short) ((r >> 16) * dequant[zig]);
+         }
+         // a coefficient at 63 ends the block without an EOB code
+         if ((r & (31 << 10)) && k < 64) {
+            // refill between the two codes the way two separate decodes would,
+            // so a scan ends at the same byte as before even on corrupt data
+            j->code_buffer <<= s;
+            j->code_bits -= s;
+            if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
+            s = (r >> 10) & 31;
+            j->code_buffer <<= s;
+            j->code_bits -= s;
+            break;
+         }
          j->code_buffer <<= s;
          j->code_bits -= s;
-         // decode into unzigzag'd location
-         zig = stbi__jpeg_dezigzag[k++];
-         data[zig] = (short) ((r >> 8) * dequant[zig]);
       } else {
          int rs = stbi__jpeg_huff_decode(j, hac);
          if (rs < 0) return stbi__err("bad huffman code","Corrupt JPEG");
@@ -2203,7 +2327,7 @@ static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__
       // first scan for DC coefficient, must be first
       memset(data,0,64*sizeof(data[0])); // 0 all the ac values now
       t = stbi__jpeg_huff_decode(j, hdc);
-      if (t == -1) return stbi__err("can't merge dc and ac", "Corrupt JPEG");
+      if (t < 0 || t > 15) return stbi__err("can't merge dc and ac", "Corrupt JPEG");
       diff = t ? stbi__extend_receive(j, t) : 0;
 
       dc = j->img_comp[b].dc_pred + diff;
@@ -2630,6 +2754,171 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT. the same arithmetic as stbi__idct_simd, so also bit-identical
+// to the generic C version, but every 32-bit stage covers all 8 columns in one
+// register (columns 0-3 in the low lane, 4-7 in the high lane) instead of two.
+STBI__AVX2_FN static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         /* packs works per lane: sum0-3 dif0-3 | sum4-7 dif4-7, put the 64-bit halves in order */ \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2889,7 +3178,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac_eob[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
                z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
@@ -2917,7 +3206,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac_eob[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
                         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                      }
                   }
@@ -3072,8 +3361,10 @@ static int stbi__process_marker(stbi__jpeg *z, int m)
             }
             for (i=0; i < n; ++i)
                v[i] = stbi__get8(z->s);
-            if (tc != 0)
+            if (tc != 0) {
                stbi__build_fast_ac(z->fast_ac[th], z->huff_ac + th);
+               stbi__build_fast_ac_eob(z->fast_ac_eob[th], z->huff_ac + th);
+            }
             L -= n;
          }
          return L==0;
@@ -3542,6 +3833,80 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// stbi__resample_row_hv_2_simd 16 pixels at a time
+STBI__AVX2_FN static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // as in the sse2 version, the last pixel in a row is left to the scalar code
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev" is the current row shifted right by 1 pixel with t1 inserted,
+      // "next" is shifted left by 1 pixel with the first pixel of the next
+      // block added. byte shifts stay inside a lane, so the pixel that crosses
+      // between the lanes comes in through alignr.
+      __m256i lo_up = _mm256_permute2x128_si256(curr, curr, 0x08); // 0 | low lane
+      __m256i hi_dn = _mm256_permute2x128_si256(curr, curr, 0x81); // high lane | 0
+      __m256i prv0  = _mm256_alignr_epi8(curr, lo_up, 14);
+      __m256i nxt0  = _mm256_alignr_epi8(hi_dn, curr, 2);
+      __m256i prev  = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next  = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal filter, polyphase:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, undo scaling. unpack and pack both work
+      // per lane, which leaves pixels 0-7 in the low lane and 8-15 in the high one
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3716,6 +4081,125 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// stbi__YCbCr_to_RGB_simd 16 pixels at a time, for RGB (step 3) as well as RGBA
+STBI__AVX2_FN static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 3 || step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+      // per lane: 4 RGBA pixels -> 12 RGB bytes, then the two lanes' 12 bytes side by side
+      __m256i drop_alpha = _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+                                            0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+      __m256i close_gap  = _mm256_setr_epi32(0,1,2,4,5,6,3,7);
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr+i));
+         __m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb+i));
+         __m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+         // widen to short the way the sse2 unpacks do: y in the high byte over
+         // a 128 rounding bias, cr and cb (signed) shifted left by 8
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose (pixels 0-7 in the low lane, 8-15 in the high lane)
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0-3 | 8-11
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4-7 | 12-15
+         __m256i p0 = _mm256_permute2x128_si256(o0, o1, 0x20); // pixels 0-7
+         __m256i p1 = _mm256_permute2x128_si256(o0, o1, 0x31); // pixels 8-15
+
+         // store
+         if (step == 4) {
+            _mm256_storeu_si256((__m256i *) (out + 0), p0);
+            _mm256_storeu_si256((__m256i *) (out + 32), p1);
+            out += 64;
+         } else {
+            __m256i q0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p0, drop_alpha), close_gap);
+            __m256i q1 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p1, drop_alpha), close_gap);
+            // 24 + 24 bytes, the first store spills 8 bytes the second one overwrites
+            _mm256_storeu_si256((__m256i *) (out + 0), q0);
+            _mm_storeu_si128((__m128i *) (out + 24), _mm256_castsi256_si128(q1));
+            _mm_storel_epi64((__m128i *) (out + 40), _mm256_extracti128_si256(q1, 1));
+            out += 48;
+         }
+      }
+   }
+
+   for (; i < count; ++i) {
+      int y_fixed = (y[i] << 20) + (1<<19); // rounding
+      int r,g,b;
+      int cr = pcr[i] - 128;
+      int cb = pcb[i] - 128;
+      r = y_fixed + cr* stbi__float2fixed(1.40200f);
+      g = y_fixed + cr*-stbi__float2fixed(0.71414f) + ((cb*-stbi__float2fixed(0.34414f)) & 0xffff0000);
+      b = y_fixed                                   +   cb* stbi__float2fixed(1.77200f);
+      r >>= 20;
+      g >>= 20;
+      b >>= 20;
+      if ((unsigned) r > 255) { if (r < 0) r = 0; else r = 255; }
+      if ((unsigned) g > 255) { if (g < 0) g = 0; else g = 255; }
+      if ((unsigned) b > 255) { if (b < 0) b = 0; else b = 255; }
+      out[0] = (stbi_uc)r;
+      out[1] = (stbi_uc)g;
+      out[2] = (stbi_uc)b;
+      out[3] = 255;
+      out += step;
+   }
+}
+#endif
+
+static int stbi__jpeg_simd_max_tier = 2;
+
+STBIDEF int stbi_jpeg_simd_limit(int max_tier)
+{
+   int tier = 0;
+   stbi__jpeg_simd_max_tier = max_tier;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) tier = 1;
+#endif
+#ifdef STBI_NEON
+   tier = 1;
+#endif
+#ifdef STBI_AVX2
+   if (tier == 1 && stbi__avx2_available()) tier = 2;
+#endif
+   return tier < max_tier ? tier : max_tier;
+}
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3724,17 +4208,27 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
 #ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
+   if (stbi__jpeg_simd_max_tier >= 1 && stbi__sse2_available()) {
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+
+#ifdef STBI_AVX2
+      if (stbi__jpeg_simd_max_tier >= 2 && stbi__avx2_available()) {
+         j->idct_block_kernel = stbi__idct_avx2;
+         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      }
+#endif
    }
 #endif
 
 #ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   if (stbi__jpeg_simd_max_tier >= 1) {
+      j->idct_block_kernel = stbi__idct_simd;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   }
 #endif
 }
 
@@ -3977,14 +4471,22 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  10 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
+#define STBI__ZSUB_SIZE   512 // second level entries, plenty for real streams
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
+//
+// two level lookup: fast[] is indexed by the next STBI__ZFAST_BITS bits and
+// holds size<<9 | symbol for codes up to that long. a longer code's entry is
+// 0x8000 | sub_bits<<11 | offset instead, the codes starting with those bits
+// are at sub[offset], indexed by the next sub_bits bits (size<<9 | symbol
+// again). 0 is "not in the tables", left to the slow way
 typedef struct
 {
    stbi__uint16 fast[1 << STBI__ZFAST_BITS];
+   stbi__uint16 sub[STBI__ZSUB_SIZE];
    stbi__uint16 firstcode[16];
    int maxcode[17];
    stbi__uint16 firstsymbol[16];
@@ -4011,8 +4513,9 @@ stbi_inline static int stbi__bit_reverse(int v, int bits)
 
 static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int num)
 {
-   int i,k=0;
+   int i,k=0,nlong=0;
    int code, next_code[16], sizes[17];
+   stbi__uint16 long_code[288], long_symbol[288];
 
    // DEFLATE spec for generating codes
    memset(sizes, 0, sizeof(sizes));
@@ -4049,13 +4552,52 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
                z->fast[j] = fastv;
                j += (1 << s);
             }
+         } else {
+            long_code[nlong] = (stbi__uint16) stbi__bit_reverse(next_code[s],s);
+            long_symbol[nlong++] = (stbi__uint16) i;
          }
          ++next_code[s];
       }
    }
+   if (nlong) {
+      // one second level table per first STBI__ZFAST_BITS bits, as big as the
+      // longest code starting with them needs
+      stbi_uc longest[1 << STBI__ZFAST_BITS];
+      int used = 0;
+      memset(longest, 0, sizeof(longest));
+      for (i=0; i < nlong; ++i) {
+         int r = long_code[i] & STBI__ZFAST_MASK, s = sizelist[long_symbol[i]];
+         if (s > longest[r]) longest[r] = (stbi_uc) s;
+      }
+      for (i=0; i < (1 << STBI__ZFAST_BITS); ++i) {
+         if (longest[i]) {
+            int bits = longest[i] - STBI__ZFAST_BITS;
+            if (used + (1 << bits) > STBI__ZSUB_SIZE) continue; // no room, these stay on the slow path
+            z->fast[i] = (stbi__uint16) (0x8000 | (bits << 11) | used);
+            used += 1 << bits;
+         }
+      }
+      memset(z->sub, 0, used * sizeof(z->sub[0]));
+      for (i=0; i < nlong; ++i) {
+         int r = long_code[i] & STBI__ZFAST_MASK, s = sizelist[long_symbol[i]];
+         int b = z->fast[r], j;
+         if (!(b & 0x8000)) continue;
+         for (j = long_code[i] >> STBI__ZFAST_BITS; j < (1 << ((b >> 11) & 15)); j += 1 << (s - STBI__ZFAST_BITS))
+            z->sub[(b & 0x7ff) + j] = (stbi__uint16) ((s << 9) | long_symbol[i]);
+      }
+   }
    return 1;
 }
 
+// the table entry for the code at the bottom of the bit buffer, 0 if there is none
+stbi_inline static int stbi__zhuffman_entry(stbi__zhuffman *z, stbi__uint64 code_buffer)
+{
+   int b = z->fast[code_buffer & STBI__ZFAST_MASK];
+   if (b & 0x8000)
+      b = z->sub[(b & 0x7ff) + ((int) (code_buffer >> STBI__ZFAST_BITS) & ((1 << ((b >> 11) & 15)) - 1))];
+   return b;
+}
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -4066,7 +4608,7 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   stbi__uint64 code_buffer;
 
    char *zout;
    char *zout_start;
@@ -4086,23 +4628,46 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
    return stbi__zeof(z) ? 0 : *z->zbuffer++;
 }
 
+// the next 8 input bytes, first byte in the low bits
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   return (stbi__uint64) (p[0] | (p[1] << 8) | (p[2] << 16) | ((stbi__uint32) p[3] << 24)) |
+          (stbi__uint64) (p[4] | (p[5] << 8) | (p[6] << 16) | ((stbi__uint32) p[7] << 24)) << 32;
+#endif
+}
+
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   if (z->code_buffer >= ((stbi__uint64) 1 << z->num_bits)) {
+     z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+     return;
+   }
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // as many whole bytes of the next 8 as fit
+      int n = (63 - z->num_bits) >> 3;
+      z->code_buffer |= (stbi__zload64(z->zbuffer) & (((stbi__uint64) 1 << (n*8)) - 1)) << z->num_bits;
+      z->zbuffer += n;
+      z->num_bits += n*8;
+      return;
+   }
    do {
-      if (z->code_buffer >= (1U << z->num_bits)) {
-        z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
-        return;
-      }
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      // past the end it pads with zeros, but no further than 24 bits like it always has
+      if (stbi__zeof(z) && z->num_bits > 24) return;
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 48);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) z->code_buffer & ((1 << n) - 1);
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -4113,7 +4678,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4136,7 +4701,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
       }
       stbi__fill_bits(a);
    }
-   b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   b = stbi__zhuffman_entry(z, a->code_buffer);
    if (b) {
       s = b >> 9;
       a->code_buffer >>= s;
@@ -4182,11 +4747,99 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// the bulk of a block: the bit buffer and output pointer live in locals, the
+// buffer is topped up to 56+ bits with one 8 byte load per symbol (enough for
+// the longest length + distance pair) and matches are copied 8 or 16 bytes at a
+// time. runs while there are 8 input bytes left and room for the longest match
+// plus the copy overshoot, and stops in front of anything it doesn't handle
+// itself (end of block, codes the tables don't resolve, bad distances) so the
+// careful loop in stbi__parse_huffman_block can take it from there
+static char *stbi__parse_huffman_fast(stbi__zbuf *a, char *zout)
+{
+   stbi_uc *in = a->zbuffer;
+   stbi__uint64 cb = a->code_buffer;
+   int nb = a->num_bits;
+
+   while (a->zbuffer_end - in >= 8 && a->zout_end - zout >= 258 + 16) {
+      int b, s, z, used, len, dist;
+      stbi__uint64 t;
+
+      // bits past nb are already the right stream bits, or-ing them again is harmless
+      cb |= stbi__zload64(in) << nb;
+      in += (63 - nb) >> 3;
+      nb |= 56;
+
+      b = stbi__zhuffman_entry(&a->z_length, cb);
+      if (!b) break;
+      s = b >> 9;
+      z = b & 511;
+      if (z < 256) {
+         cb >>= s;
+         nb -= s;
+         *zout++ = (char) z;
+         // 41+ bits are left, plenty for another literal before the next refill
+         b = stbi__zhuffman_entry(&a->z_length, cb);
+         if (b && (b & 511) < 256) {
+            s = b >> 9;
+            cb >>= s;
+            nb -= s;
+            *zout++ = (char) b;
+         }
+         continue;
+      }
+      if (z == 256) break;
+
+      // peek the whole length + distance pair, nothing is consumed unless it all resolves
+      z -= 257;
+      t = cb >> s;
+      used = s + stbi__zlength_extra[z];
+      len = stbi__zlength_base[z] + (int) (t & ((1 << stbi__zlength_extra[z]) - 1));
+      t >>= stbi__zlength_extra[z];
+      b = stbi__zhuffman_entry(&a->z_distance, t);
+      if (!b) break;
+      s = b >> 9;
+      z = b & 511;
+      t >>= s;
+      used += s + stbi__zdist_extra[z];
+      dist = stbi__zdist_base[z] + (int) (t & ((1 << stbi__zdist_extra[z]) - 1));
+      if (dist == 0 || zout - a->zout_start < dist) break;
+      cb >>= used;
+      nb -= used;
+
+      {
+         char *p = zout - dist, *end = zout + len;
+         if (dist >= 16) {
+            do { memcpy(zout, p, 16); zout += 16; p += 16; } while (zout < end);
+         } else if (dist >= 8) {
+            do { memcpy(zout, p, 8); zout += 8; p += 8; } while (zout < end);
+         } else if (dist == 1) {
+            memset(zout, *p, len); // run of one byte; common in images.
+         } else {
+            // the first 8 bytes one at a time, after that the pattern repeats
+            // at a multiple of dist that is at least 8 bytes back
+            int i, n = len < 8 ? len : 8;
+            for (i=0; i < n; ++i) zout[i] = p[i];
+            zout += n;
+            p = zout - dist * ((8 + dist - 1) / dist);
+            while (zout < end) { memcpy(zout, p, 8); zout += 8; p += 8; }
+         }
+         zout = end;
+      }
+   }
+
+   a->zbuffer = in;
+   a->code_buffer = cb & (((stbi__uint64) 1 << nb) - 1);
+   a->num_bits = nb;
+   return zout;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      zout = stbi__parse_huffman_fast(a, zout);
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4282,7 +4935,7 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
@@ -4294,9 +4947,16 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   // the bit buffer reads ahead, the first few bytes of the block can be in it already
+   while (a->num_bits > 0 && len > 0) {
+      *a->zout++ = (char) (a->code_buffer & 255);
+      a->code_buffer >>= 8;
+      a->num_bits -= 8;
+      --len;
+   }
+   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4535,6 +5195,125 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+static int stbi__png_simd_max_tier = 1;
+
+STBIDEF int stbi_png_simd_limit(int max_tier)
+{
+   int tier = 0;
+   stbi__png_simd_max_tier = max_tier;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) tier = 1;
+#endif
+   return tier < max_tier ? tier : max_tier;
+}
+
+#ifdef STBI_SSE2
+// SSE2 row filters, the same bytes as the C loops in stbi__create_png_image_raw.
+// Up is 16 bytes at a time; Sub, Avg and Paeth depend on the pixel to the left,
+// so they go one pixel at a time but do all of its bytes at once (and Paeth
+// without branches). cur/raw/prior point at the second pixel like in the C
+// loops, count pixels follow, bpp bytes each in raw and out_bpp in cur/prior
+// (bpp+1 when adding an opaque alpha). only 8-bit RGB and RGBA take the pixel
+// at a time path, returns 0 when the C loops have to do it
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp, int last)
+{
+   int v;
+   if (bpp == 3 && last) // the 4 byte load would read past the row
+      return _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i x, int bpp, int last)
+{
+   int v = _mm_cvtsi128_si32(x);
+   if (bpp == 3 && last) {
+      p[0] = (stbi_uc) v; p[1] = (stbi_uc) (v >> 8); p[2] = (stbi_uc) (v >> 16);
+   } else
+      memcpy(p, &v, 4); // a 3 byte pixel's 4th byte is the next pixel's first, rewritten next
+}
+
+static int stbi__png_filter_simd(int filter, stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, int count, int bpp, int out_bpp)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i alpha = _mm_cvtsi32_si128(out_bpp != bpp ? (int) 0xff000000 : 0);
+   __m128i a, b, c;
+   int i;
+
+   if (filter == STBI__F_up && out_bpp == bpp) {
+      int k = 0, nk = count * bpp;
+      for (; k+16 <= nk; k += 16)
+         _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(_mm_loadu_si128((__m128i *) (raw+k)), _mm_loadu_si128((__m128i *) (prior+k))));
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+
+   if ((bpp != 3 && bpp != 4) || out_bpp < bpp || (filter == STBI__F_none && out_bpp == bpp))
+      return 0; // (the C loop turns that last one into a memcpy)
+   if (count <= 0)
+      return 1;
+
+   a = stbi__png_load_pixel(cur - out_bpp, out_bpp, 1);
+
+   switch (filter) {
+      case STBI__F_none:
+         for (i=0; i < count; ++i, raw += bpp, cur += out_bpp)
+            stbi__png_store_pixel(cur, _mm_or_si128(stbi__png_load_pixel(raw, bpp, i+1 == count), alpha), out_bpp, i+1 == count);
+         break;
+      case STBI__F_up:
+         for (i=0; i < count; ++i, raw += bpp, cur += out_bpp, prior += out_bpp) {
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, bpp, i+1 == count), stbi__png_load_pixel(prior, out_bpp, i+1 == count));
+            stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), out_bpp, i+1 == count);
+         }
+         break;
+      case STBI__F_sub:
+         for (i=0; i < count; ++i, raw += bpp, cur += out_bpp) {
+            a = _mm_or_si128(_mm_add_epi8(stbi__png_load_pixel(raw, bpp, i+1 == count), a), alpha);
+            stbi__png_store_pixel(cur, a, out_bpp, i+1 == count);
+         }
+         break;
+      case STBI__F_avg:
+         for (i=0; i < count; ++i, raw += bpp, cur += out_bpp, prior += out_bpp) {
+            // (a+b)>>1 from the rounding-up average
+            b = stbi__png_load_pixel(prior, out_bpp, i+1 == count);
+            c = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, bpp, i+1 == count), _mm_sub_epi8(_mm_avg_epu8(a, b), c));
+            a = _mm_or_si128(a, alpha);
+            stbi__png_store_pixel(cur, a, out_bpp, i+1 == count);
+         }
+         break;
+      case STBI__F_paeth:
+         // 16-bit lanes: pa = |b-c|, pb = |a-c|, pc = |a+b-2c|, ties go to a, then b
+         alpha = _mm_unpacklo_epi8(alpha, zero);
+         a = _mm_unpacklo_epi8(a, zero);
+         c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - out_bpp, out_bpp, 1), zero);
+         for (i=0; i < count; ++i, raw += bpp, cur += out_bpp, prior += out_bpp) {
+            __m128i pa, pb, pc, smallest, nearest;
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, out_bpp, i+1 == count), zero);
+            pa = _mm_sub_epi16(b, c);
+            pb = _mm_sub_epi16(a, c);
+            pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            nearest = c;
+            nearest = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi16(smallest, pb), b), _mm_andnot_si128(_mm_cmpeq_epi16(smallest, pb), nearest));
+            nearest = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi16(smallest, pa), a), _mm_andnot_si128(_mm_cmpeq_epi16(smallest, pa), nearest));
+            a = _mm_and_si128(_mm_add_epi16(_mm_unpacklo_epi8(stbi__png_load_pixel(raw, bpp, i+1 == count), zero), nearest), _mm_set1_epi16(255));
+            a = _mm_or_si128(a, alpha);
+            stbi__png_store_pixel(cur, _mm_packus_epi16(a, a), out_bpp, i+1 == count);
+            c = b;
+         }
+         break;
+      default:
+         return 0;
+   }
+   return 1;
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4617,10 +5396,15 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
+         int done = 0;
+#ifdef STBI_SSE2
+         if (stbi__png_simd_max_tier >= 1 && stbi__sse2_available())
+            done = stbi__png_filter_simd(filter, cur, raw, prior, width - 1, filter_bytes, filter_bytes);
+#endif
          #define STBI__CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
-         switch (filter) {
+         if (!done) switch (filter) {
             // "none" filter turns into a memcpy here; make that explicit.
             case STBI__F_none:         memcpy(cur, raw, nk); break;
             STBI__CASE(STBI__F_sub)          { cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]); } break;
@@ -4633,12 +5417,19 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          #undef STBI__CASE
          raw += nk;
       } else {
+         int done = 0;
          STBI_ASSERT(img_n+1 == out_n);
+#ifdef STBI_SSE2
+         if (depth == 8 && stbi__png_simd_max_tier >= 1 && stbi__sse2_available()) {
+            done = stbi__png_filter_simd(filter, cur, raw, prior, x - 1, filter_bytes, output_bytes);
+            if (done) raw += (x - 1) * filter_bytes;
+         }
+#endif
          #define STBI__CASE(f) \
              case f:     \
                 for (i=x-1; i >= 1; --i, cur[filter_bytes]=255,raw+=filter_bytes,cur+=output_bytes,prior+=output_bytes) \
                    for (k=0; k < filter_bytes; ++k)
-         switch (filter) {
+         if (!done) switch (filter) {
             STBI__CASE(STBI__F_none)         { cur[k] = raw[k]; } break;
             STBI__CASE(STBI__F_sub)          { cur[k] = STBI__BYTECAST(raw[k] + cur[k- output_bytes]); } break;
             STBI__CASE(STBI__F_up)           { cur[k] = STBI__BYTECAST(raw[k] + prior[k]); } break;
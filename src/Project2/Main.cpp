@@ -21,9 +21,29 @@
 #include <cmath>
 #include <vector>
 #include <filesystem>
+#include <memory>
 
 #include "shader_s.h"
 #include "renderer.h"
+#include "instanced_renderer.h"
+#include "frame_uniforms.h"
+#include "render_queue.h"
+#include "static_batch.h"
+#include "culling.h"
+#include "transform_hierarchy.h"
+#include "job_system.h"
+#include "ring_buffer.h"
+#include "headless.h"
+#include "gpu_profiler.h"
+#include "trace.h"
+#include "shader_watcher.h"
+#include "shader_variants.h"
+#include "procedural_texture.h"
+#include "tile_uploader.h"
+#include "image.h"
+#include "texture_loader.h"
+#include "cube_map.h"
+#include "skybox.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -31,31 +51,79 @@
 glm::mat4 pMat; // perspective matrix
 glm::mat4 vMat; // view matrix
 
+// CPU cost of submitting the scene, smoothed over frames and shown in the imGui window
+double sceneSubmitMs = 0.0;
+unsigned int sceneDrawCount = 0;
+
+// draws are sorted by state each frame, instead of being issued in insertion order
+RenderQueue renderQueue;
+
+// objects outside the view frustum are dropped before they reach the render queue
+bool frustumCulling = true;
+unsigned int visibleCount = 0, cullCandidateCount = 0;
+
+// parent/child transforms, world matrices only get recomputed for nodes that changed
+TransformHierarchy sceneGraph;
+bool showChildQuad = false;
+
 // settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
 
 unsigned int texture;
+TileUploader textureUploader; // sends the changed tiles of imageBuff to texture
 
 // image buffer used by raster drawing basics.cpp
-extern unsigned char imageBuff[512][512][3];
+extern Image imageBuff;
+extern DirtyTiles imageDirty;
+
+int resizeImage(int width, int height, PixelFormat format, ImageLayout layout);
+
+int myTexture(const proctex::Params& params = proctex::Params(), proctex::Isa isa = proctex::bestIsa());
+int myRaster(float angle, int cubes);
+int myPaint(float time);
+int rasterBenchmark(int frames, int triangles);
+int textureBenchmark(int frames);
+int decodeBenchmark(int runs);
+
+// procedural texture settings (basics.cpp fills imageBuff from these), regenerated whenever they change
+proctex::Params textureParams;
+int textureIsa = (int)proctex::bestIsa();
+double textureMs = 0.0;
+
+int textureUploadKB = 4096; // TextureLoader::uploadBudget
+
+// software rasterizer drawing a field of cubes into imageBuff (basics.cpp), optionally every frame
+int rasterCubes = 64;
+bool animateRaster = false;
+bool animatePaint = false; // a few pixels of imageBuff change every frame
+
+// number of quads drawn by the instanced batch (0 = off), set from imGui
+int instancedQuadCount = 0;
+bool animateInstances = false; // rewrite the instance matrices every frame through the streaming ring buffer
+
+// a field of quads that never move, drawn one by one or merged into a static batch (compare the submit times)
+bool showStaticQuads = false;
+bool batchStaticQuads = false;
+
+// data/cubeMap around the scene, drawn after everything else
+bool showSkybox = true;
+
+// the quad "mesh", shared by QuadRenderer and the instanced batch
+// ------------------------------------------------------------------
+const float quadVertices[12] = {
+     0.5f,  0.5f, 0.0f,  // top right
+     0.5f, -0.5f, 0.0f,  // bottom right
+    -0.5f, -0.5f, 0.0f,  // bottom left
+    -0.5f,  0.5f, 0.0f   // top left 
+};
 
-int myTexture();
+const unsigned int quadIndices[6] = {  // note that we start from 0!
+    0, 1, 3,  // first Triangle
+    1, 2, 3   // second Triangle
+};
 
 class QuadRenderer : public renderer {
-    // ------------------------------------------------------------------
-    float vertices[12] = {
-         0.5f,  0.5f, 0.0f,  // top right
-         0.5f, -0.5f, 0.0f,  // bottom right
-        -0.5f, -0.5f, 0.0f,  // bottom left
-        -0.5f,  0.5f, 0.0f   // top left 
-    };
-
-protected: 
-    unsigned int indices[6] = {  // note that we start from 0!
-        0, 1, 3,  // first Triangle
-        1, 2, 3   // second Triangle
-    };
 
     public : QuadRenderer(Shader *shader,glm::mat4 m) 
     {
@@ -74,7 +142,7 @@ protected:
         // vertex buffer object, simple version, just coordinates
 
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
 
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
@@ -84,9 +152,15 @@ protected:
 
         // set up the element array buffer containing the vertex indices for the "mesh"
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
 
-        indexCount = sizeof(indices) / sizeof(unsigned int);
+        indexCount = sizeof(quadIndices) / sizeof(unsigned int);
+
+        // keep a CPU copy around so the quad can be merged into a static batch
+        meshVertices.assign(quadVertices, quadVertices + 12);
+        meshIndices.assign(quadIndices, quadIndices + 6);
+
+        computeMeshBounds();
 
         // remember: do NOT unbind the EBO while a VAO is active, as the bound element buffer object IS stored in the VAO; keep the EBO bound.
         // don't be tempted to do this --->  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -99,6 +173,24 @@ protected:
 
 #pragma warning( disable : 26451 )
 
+// lay out count small quads on a square grid in front of the camera
+std::vector<glm::mat4> quadGrid(int count)
+{
+    std::vector<glm::mat4> matrices(count);
+
+    int side = (int)std::ceil(std::sqrt((double)count));
+    float cell = 4.0f / side;
+
+    for (int i = 0; i < count; i++)
+    {
+        glm::vec3 pos(-2.0f + cell * ((i % side) + 0.5f), -2.0f + cell * ((i / side) + 0.5f), 0.0f);
+
+        matrices[i] = glm::scale(glm::translate(glm::mat4(1.0f), pos), glm::vec3(cell * 0.8f));
+    }
+
+    return matrices;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
 void setupTextures()
@@ -118,12 +210,36 @@ void setupTextures()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    // load image, create texture and generate mipmaps
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 512, 512, 0, GL_RGB, GL_UNSIGNED_BYTE, (const void*)imageBuff);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // storage only, the pixels follow tile by tile in uploadTexture. with NEAREST minification the mip levels are
+    // never sampled, so they aren't rebuilt after every upload (set textureUploader.mipmaps with a mipmapped filter)
+    TileUploader::allocate(texture, imageBuff);
+    imageDirty.markAll();
+}
+
+// copy the changed parts of imageBuff into the texture, done inside the frame so the profiler can see what it costs
+void uploadTexture(RingBuffer& streamBuffer)
+{
+    textureUploader.upload(texture, imageBuff, imageDirty, streamBuffer);
 }
 
-void drawIMGUI(Shader *ourShader,renderer *myRenderer) {
+// multiline text field editing a std::string in place, imGui asks for a bigger buffer through the resize callback
+// -------------------------------------------------------------------------------
+bool InputTextMultiline(const char* label, std::string* text, const ImVec2& size, ImGuiInputTextFlags flags)
+{
+    auto resize = [](ImGuiInputTextCallbackData* data) -> int {
+        if (data->EventFlag == ImGuiInputTextFlags_CallbackResize)
+        {
+            std::string* str = (std::string*)data->UserData;
+            str->resize(data->BufTextLen);
+            data->Buf = &(*str)[0];
+        }
+        return 0;
+    };
+
+    return ImGui::InputTextMultiline(label, &(*text)[0], text->capacity() + 1, size, flags | ImGuiInputTextFlags_CallbackResize, resize, text);
+}
+
+void drawIMGUI(Shader *ourShader,renderer *myRenderer, GpuProfiler *profiler, TextureLoader *textureLoader) {
     // Show a simple window that we create ourselves. We use a Begin/End pair to created a named window.
     {
         // used to get values from imGui to the model matrix
@@ -133,30 +249,82 @@ void drawIMGUI(Shader *ourShader,renderer *myRenderer) {
         static float transVec[] = { 0.0f,0.0f,0.0f };
         static float scaleVec[] = { 1.0f,1.0f,1.0f };
 
+        G4G_PROFILE_SCOPE(*profiler, "ImGui");
+
         // Start the Dear ImGui frame
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        profiler->push("NewFrame");
+        {
+            G4G_TRACE_SCOPE("ImGui::NewFrame");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+        }
+        profiler->pop();
 
         ImGui::Begin("Graphics For Games");  // Create a window and append into it.
 
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
+        // CPU side cost of the draws, flip the checkbox to compare against asking the driver for every uniform location
+        ImGui::Text("Scene submit %.3f ms, %.2f us/draw (%u draws)", sceneSubmitMs, sceneDrawCount ? 1000.0 * sceneSubmitMs / sceneDrawCount : 0.0, sceneDrawCount);
+        ImGui::Checkbox("Bypass uniform location cache", &Shader::bypassUniformCache);
+
+        // per pass CPU/GPU breakdown
+        if (ImGui::CollapsingHeader("Profiler"))
+        {
+            profiler->drawUI();
+#ifdef G4G_TRACE
+            if (ImGui::Button("Dump Trace"))
+                trace::dumpChromeJSON("trace.json");
+            ImGui::SameLine();
+            ImGui::Text("last %zu events per thread to trace.json", trace::ThreadBuffer::CAPACITY);
+#endif
+        }
+
+        ImGui::Checkbox("Child quad (follows the first quad)", &showChildQuad);
+        ImGui::SameLine();
+        ImGui::Text("%u of %d transforms updated", sceneGraph.updatedCount, sceneGraph.size());
+
+        ImGui::Checkbox("Frustum culling", &frustumCulling);
+        ImGui::SameLine();
+        ImGui::Text("%u of %u objects visible", visibleCount, cullCandidateCount);
+
+        const RenderQueue::Stats& rs = renderQueue.stats;
+        ImGui::Text("Redundant binds skipped %u (program %u/%u, VAO %u/%u, texture %u/%u skipped/bound)", rs.skipped(),
+            rs.programSkips, rs.programBinds, rs.vaoSkips, rs.vaoBinds, rs.textureSkips, rs.textureBinds);
+
+        // many quads in one draw call
+        ImGui::DragInt("Instanced quads", &instancedQuadCount, 100.0f, 0, 100000);
+        ImGui::SameLine();
+        ImGui::Checkbox("Animate", &animateInstances);
+
+        ImGui::Checkbox("Static quads", &showStaticQuads);
+        ImGui::SameLine();
+        ImGui::Checkbox("Merge into static batch (multi draw indirect)", &batchStaticQuads);
+
+        ImGui::Checkbox("Skybox", &showSkybox);
+
         static ImGuiInputTextFlags flags = ImGuiInputTextFlags_AllowTabInput;
         
         ImGui::Text("Vertex Shader");
         ImGui::SameLine();
-        ImGui::Text(std::filesystem::absolute("./data/vertex.glsl").u8string().c_str());
-        ImGui::InputTextMultiline("Vertex Shader", ourShader->vtext, IM_ARRAYSIZE(ourShader->vtext), ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 16), flags);
+        ImGui::Text("%s", std::filesystem::absolute(ourShader->vertexPath).u8string().c_str());
+        InputTextMultiline("Vertex Shader", &ourShader->vtext, ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 16), flags);
         
         ImGui::Text("Fragment Shader" );
         ImGui::SameLine();
-        ImGui::Text(std::filesystem::absolute("./data/fragment.glsl").u8string().c_str());
-        ImGui::InputTextMultiline("Fragment Shader", ourShader->ftext, IM_ARRAYSIZE(ourShader->ftext), ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 16), flags);
+        ImGui::Text("%s", std::filesystem::absolute(ourShader->fragmentPath).u8string().c_str());
+        InputTextMultiline("Fragment Shader", &ourShader->ftext, ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 16), flags);
 
         if (ImGui::Button("reCompile Shaders"))
             ourShader->reload();
 
+        if (ourShader->compiling())
+        {
+            ImGui::SameLine();
+            ImGui::Text("compiling...");
+        }
+
         ImGui::SameLine();
 
         if (ImGui::Button("Save Shaders"))
@@ -168,16 +336,136 @@ void drawIMGUI(Shader *ourShader,renderer *myRenderer) {
         ImGui::SliderAngle("Angle", &angle,-90.0f,90.0f);
         ImGui::DragFloat3("Scale", scaleVec,.01f,-3.0f,3.0f);
 
-        // show the texture that we generated
-        ImGui::Image((void*)(intptr_t)texture, ImVec2(64, 64));
+        // show the texture that we generated, at the image's aspect ratio
+        ImGui::Image((void*)(intptr_t)texture, ImVec2(64.0f * imageBuff.width() / std::max(imageBuff.height(), 1), 64.0f));
+        ImGui::SameLine();
+
+        bool regenerate = ImGui::Button("Regenerate Texture");
+
+        ImGui::SameLine();
+
+        if (ImGui::Button("Rasterize Cubes"))
+        {
+            myRaster(0.0f, rasterCubes);
+        }
+
+        ImGui::SliderInt("Cubes", &rasterCubes, 1, 10000);
+        ImGui::SameLine();
+        ImGui::Checkbox("Spin (software raster every frame)", &animateRaster);
+        ImGui::Checkbox("Paint (a few pixels every frame)", &animatePaint);
+        ImGui::Text("Texture upload: %zu/%zu tiles in %zu rects, %.1f KB", textureUploader.tiles, imageDirty.tileCount(),
+            textureUploader.rects, textureUploader.bytes / 1024.0);
+
+        if (ImGui::CollapsingHeader("Image"))
+        {
+            static const char* sizes[] = { "64", "128", "256", "512", "1024", "2048", "4096" };
+            auto formatItem = [](void*, int i, const char** out) { *out = formatName((PixelFormat)i); return true; };
+
+            // log2 of the size, starting at 64
+            static int widthIndex = 3, heightIndex = 3;
+            static int format = (int)imageBuff.format();
+            static bool tiled = !imageBuff.linear();
+
+            ImGui::Text("%d x %d %s %s, %zu bytes per row, %.1f KB", imageBuff.width(), imageBuff.height(), formatName(imageBuff.format()),
+                imageBuff.linear() ? "linear" : "tiled", imageBuff.pitch(), imageBuff.sizeBytes() / 1024.0);
+
+            ImGui::Combo("Width", &widthIndex, sizes, IM_ARRAYSIZE(sizes));
+            ImGui::Combo("Height", &heightIndex, sizes, IM_ARRAYSIZE(sizes));
+            ImGui::Combo("Format", &format, formatItem, nullptr, (int)PixelFormat::RGBA16F + 1);
+            ImGui::Checkbox("Tiled (Morton order 8x8 tiles)", &tiled);
+
+            if (ImGui::Button("Reallocate"))
+            {
+                resizeImage(64 << widthIndex, 64 << heightIndex, (PixelFormat)format, tiled ? ImageLayout::Tiled : ImageLayout::Linear);
+                TileUploader::allocate(texture, imageBuff);
+                regenerate = true;
+            }
+        }
+
+        // image files from data/, decoded in the background and shown as the placeholder until they are uploaded
+        if (ImGui::CollapsingHeader("Texture Loader"))
+        {
+            static const char* files[] = { "data/brick1.jpg", "data/rpi.png", "data/unicorn.png", "data/cubeMap/xp.jpg",
+                "data/cubeMap/xn.jpg", "data/cubeMap/yp.jpg", "data/cubeMap/yn.jpg", "data/cubeMap/zp.jpg", "data/cubeMap/zn.jpg" };
+            const int fileCount = IM_ARRAYSIZE(files);
+
+            if (ImGui::Button("Load data images"))
+                for (int i = 0; i < fileCount; i++)
+                    textureLoader->load(files[i]);
+
+            ImGui::SameLine();
+
+            if (ImGui::Button("Load 500"))
+                for (int i = 0; i < 500; i++)
+                    textureLoader->load(files[i % fileCount]);
+
+            ImGui::Text("%zu textures, %d decoding, %zu uploading", textureLoader->size(), textureLoader->decoding(), textureLoader->uploading());
+            ImGui::SliderInt("Upload KB per frame", &textureUploadKB, 64, 16384);
+            textureLoader->uploadBudget = (size_t)textureUploadKB * 1024;
+
+            // the most recent ones, loaded bottom row first so the v coordinate is flipped for imGui
+            size_t first = textureLoader->size() > 16 ? textureLoader->size() - 16 : 0;
+            for (size_t h = first; h < textureLoader->size(); h++)
+            {
+                if ((h - first) % 8)
+                    ImGui::SameLine();
+                ImGui::Image((void*)(intptr_t)textureLoader->texture((TextureLoader::Handle)h), ImVec2(40, 40), ImVec2(0, 1), ImVec2(1, 0));
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Procedural Texture"))
+        {
+            auto patternItem = [](void*, int i, const char** out) { *out = proctex::patternName((proctex::Pattern)i); return true; };
+            auto isaItem = [](void*, int i, const char** out) { *out = proctex::isaName((proctex::Isa)i); return true; };
+
+            int pattern = (int)textureParams.pattern;
+            if (ImGui::Combo("Pattern", &pattern, patternItem, nullptr, (int)proctex::Pattern::Voronoi + 1))
+            {
+                textureParams.pattern = (proctex::Pattern)pattern;
+                regenerate = true;
+            }
+
+            regenerate |= ImGui::SliderFloat("Cell size", &textureParams.scale, 1.0f, 256.0f);
+            regenerate |= ImGui::ColorEdit3("Color A", &textureParams.colorA[0]);
+            regenerate |= ImGui::ColorEdit3("Color B", &textureParams.colorB[0]);
+
+            if (textureParams.pattern == proctex::Pattern::Gradient)
+                regenerate |= ImGui::SliderFloat("Direction", &textureParams.angle, 0.0f, 360.0f);
+            else if (textureParams.pattern == proctex::Pattern::Voronoi)
+                regenerate |= ImGui::SliderFloat("Jitter", &textureParams.jitter, 0.0f, 1.0f);
+            else if (textureParams.pattern != proctex::Pattern::Checker)
+                regenerate |= ImGui::SliderInt("Octaves", &textureParams.octaves, 1, 8);
+
+            if (textureParams.pattern >= proctex::Pattern::ValueNoise)
+                regenerate |= ImGui::DragFloat2("Offset", &textureParams.offsetX, 0.01f);
+
+            // only what this CPU can run
+            regenerate |= ImGui::Combo("Instruction set", &textureIsa, isaItem, nullptr, (int)proctex::bestIsa() + 1);
+            ImGui::Text("%.2f ms", textureMs);
+        }
+
+        if (regenerate)
+        {
+            double start = glfwGetTime();
+            myTexture(textureParams, (proctex::Isa)textureIsa);
+            textureMs = (glfwGetTime() - start) * 1000.0;
+        }
 
         //ImGui::ShowDemoWindow(); // easter agg!  show the ImGui demo window
 
         ImGui::End();
 
         // IMGUI Rendering
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler->push("Render");
+        {
+            G4G_TRACE_SCOPE("ImGui::Render");
+            ImGui::Render();
+        }
+        {
+            G4G_TRACE_SCOPE("ImGui_ImplOpenGL3_RenderDrawData");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        profiler->pop();
 
         // factor in the results of imgui tweaks for the next round...
         myRenderer->setXForm(glm::mat4(1.0f));
@@ -187,8 +475,11 @@ void drawIMGUI(Shader *ourShader,renderer *myRenderer) {
     }
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // --headless renders a fixed number of frames offscreen, prints timings and exits (see headless.h for all options)
+    HeadlessOptions headless = HeadlessOptions::parse(argc, argv);
+
     namespace fs = std::filesystem;
     std::cout << "Current path is " << fs::current_path() << '\n';
 
@@ -201,9 +492,21 @@ int main()
 
     std::cout << "Absolute path for shaders is " << std::filesystem::absolute("./data/") << '\n';
 
+    // CPU only, runs before any window or context exists
+    if (headless.rasterBenchFrames)
+        return rasterBenchmark(headless.rasterBenchFrames, headless.rasterBenchTriangles);
+    if (headless.textureBenchFrames)
+        return textureBenchmark(headless.textureBenchFrames);
+    if (headless.decodeBenchRuns)
+        return decodeBenchmark(headless.decodeBenchRuns);
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // this runs when main returns, after everything declared below is gone (their destructors still need the GL context)
+    struct GlfwTerminator { ~GlfwTerminator() { glfwTerminate(); } } glfwTerminator;
     const char* glsl_version = "#version 150";
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
@@ -212,6 +515,16 @@ int main()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+
+    if (headless.enabled)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // the window only exists to own the context, we draw into an FBO
+
+        if (headless.egl)
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        else if (headless.osmesa)
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    }
     // glfw window creation
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Graphics4Games Fall 2021", NULL, NULL);
@@ -232,6 +545,11 @@ int main()
         return -1;
     }
 
+    // let the driver compile and link shaders on its own threads (the ARB and KHR extensions share the enums)
+    Shader::parallelCompile = GLAD_GL_ARB_parallel_shader_compile || glfwExtensionSupported("GL_KHR_parallel_shader_compile");
+    if (GLAD_GL_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF); // as many as the driver likes
+
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -241,13 +559,27 @@ int main()
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
-    Shader ourShader("data/vertex.lgsl", "data/fragment.lgsl"); // declare and intialize our shader
+    // every shader permutation the scene uses is built up front, they compile side by side
+    ShaderVariants shaderVariants;
+    shaderVariants.precompile({
+        { "data/vertex.lgsl", "data/fragment.lgsl", {} },
+        { "data/vertex.lgsl", "data/fragment.lgsl", { "INSTANCED" } },
+        { "data/skybox_vertex.lgsl", "data/skybox_fragment.lgsl", {} },
+    });
+
+    Shader& ourShader = *shaderVariants.get("data/vertex.lgsl", "data/fragment.lgsl"); // declare and intialize our shader
 
     myTexture();
     setupTextures();
 
+    // per pass CPU and GPU timings, shown in the imGui window
+    GpuProfiler profiler;
+
+    // camera matrices go to the shaders through one uniform buffer, updated once per frame
+    FrameUniforms frameUniforms;
+
     // set up the perspective and the camera
-    pMat = glm::perspective(1.0472f, ((float)SCR_WIDTH / (float)SCR_HEIGHT), 0.0f, 100.0f);	//  1.0472 radians = 60 degrees
+    pMat = glm::perspective(1.0472f, ((float)SCR_WIDTH / (float)SCR_HEIGHT), 0.1f, 1000.0f);	//  1.0472 radians = 60 degrees
     vMat = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f,0.0f,-3.0f));
 
     // pave the way for "scene" rendering
@@ -257,6 +589,74 @@ int main()
     
     renderers.push_back(&myQuad); // add it to the render list
 
+    // the first quad drives a node in the scene graph, a smaller quad hangs off it as a child
+    myQuad.attachTransform(&sceneGraph, sceneGraph.createNode());
+
+    glm::mat4 childXForm = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(1.2f, 0.0f, 0.0f)), glm::vec3(0.5f, 0.5f, 0.5f));
+
+    QuadRenderer childQuad(&ourShader, childXForm);
+    childQuad.attachTransform(&sceneGraph, sceneGraph.createNode(myQuad.getTransformNode()));
+
+    // a batch of quads sharing one VAO, drawn with a single instanced call
+    Shader& instancedShader = *shaderVariants.get("data/vertex.lgsl", "data/fragment.lgsl", { "INSTANCED" });
+
+    InstancedRenderer quadBatch(&instancedShader, quadVertices, 12, quadIndices, 6);
+    int quadBatchCount = 0;
+    std::vector<glm::mat4> quadBatchMatrices;
+
+    // per frame dynamic data is streamed through a persistently mapped, fenced ring buffer
+    RingBuffer streamBuffer(4 * 1024 * 1024);
+
+    // reloads shaders whose files change on disk
+    ShaderWatcher shaderWatcher;
+
+    // image files decoded on the job system, uploaded a few MB per frame through streamBuffer
+    TextureLoader textureLoader;
+
+    renderers.push_back(&quadBatch);
+
+    // the six faces decode in parallel on the job system
+    CubeMapTexture skyboxTexture("data/cubeMap");
+    SkyboxRenderer skybox(shaderVariants.get("data/skybox_vertex.lgsl", "data/skybox_fragment.lgsl"), &skyboxTexture);
+
+    // the scene writes depth so the skybox (at the far plane) only fills what is left uncovered,
+    // LEQUAL keeps the draw order for the coplanar quads
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+
+    // static quads sit a bit behind the first quad, they opt in to the batch with staticBatch.add()
+    std::vector<std::unique_ptr<QuadRenderer>> staticQuads;
+
+    for (const glm::mat4& m : quadGrid(1024))
+        staticQuads.push_back(std::make_unique<QuadRenderer>(&ourShader, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -1.0f)) * m));
+
+    StaticBatch staticBatch;
+
+    BoundsTree boundsTree;
+    std::vector<renderer*> candidates, visible;
+
+    // headless runs take their scene setup from the command line and render into an offscreen target
+    std::unique_ptr<OffscreenTarget> offscreen;
+    std::unique_ptr<FrameTimings> frameTimings;
+    int frame = 0;
+
+    if (headless.enabled)
+    {
+        std::cout << "Headless run of " << headless.frames << " frames on " << glGetString(GL_RENDERER) << '\n';
+
+        instancedQuadCount = headless.instances;
+        animateInstances = headless.animate;
+        showStaticQuads = headless.staticQuads;
+        batchStaticQuads = headless.batch;
+        frustumCulling = headless.cull;
+
+        offscreen = std::make_unique<OffscreenTarget>(SCR_WIDTH, SCR_HEIGHT);
+        frameTimings = std::make_unique<FrameTimings>(headless.frames);
+
+        if (!headless.dumpDir.empty())
+            fs::create_directories(headless.dumpDir);
+    }
+
     // easter egg!  add another quad to the render list
     /*
     glm::mat4 tf2 =glm::translate(glm::mat4(1.0f), glm::vec3(-1.5f, 0.0f, 0.0f));
@@ -271,42 +671,242 @@ int main()
 
     double lastTime = glfwGetTime();
 
-    while (!glfwWindowShouldClose(window))
+    G4G_TRACE_THREAD_NAME("GL thread");
+
+    while (headless.enabled ? frame < headless.frames : !glfwWindowShouldClose(window))
     {
+        G4G_TRACE_SCOPE("Frame");
+
         // just like in a game engine, it's useful to know the delta time
-        double currentTime = glfwGetTime();
+        // (headless runs step a fixed 60Hz clock so dumped frames are reproducible)
+        double currentTime = headless.enabled ? frame / 60.0 : glfwGetTime();
         double deltaTime = currentTime - lastTime;
         lastTime = currentTime;
 
+        double frameStart = glfwGetTime();
+
+        if (headless.enabled)
+        {
+            offscreen->bind();
+            frameTimings->beginFrame(frame);
+        }
+
         // glfw: poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwPollEvents();
+        {
+            G4G_TRACE_SCOPE("glfwPollEvents");
+            glfwPollEvents();
+        }
 
         // input
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             glfwSetWindowShouldClose(window, true);
 
+        profiler.beginFrame();
+
+        // shader files edited on disk are reloaded, then programs whose background link has finished are picked up
+        // (until then the old ones keep drawing)
+        shaderWatcher.apply();
+        for (Shader* s : Shader::liveShaders())
+            s->poll();
+
+        if (animateRaster)
+        {
+            G4G_PROFILE_SCOPE(profiler, "Software raster");
+            myRaster((float)currentTime, rasterCubes);
+        }
+
+        if (animatePaint)
+            myPaint((float)currentTime);
+
+        // the texture upload is the first thing streamed through this frame's region
+        streamBuffer.beginFrame();
+
+        if (imageDirty.any())
+        {
+            G4G_PROFILE_SCOPE(profiler, "Texture upload");
+            uploadTexture(streamBuffer);
+        }
+
+        if (textureLoader.decoding() || textureLoader.uploading())
+        {
+            G4G_PROFILE_SCOPE(profiler, "Texture loader");
+            textureLoader.update(streamBuffer);
+        }
+
+        profiler.push("Scene");
+
         // render background
         // ------
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
         glClear(GL_DEPTH_BUFFER_BIT);
 
+        // rebuild the instance matrices only when the requested count changes
+        // (also puts the static matrices back once the animation is switched off)
+        if (instancedQuadCount != quadBatchCount || (!animateInstances && quadBatch.isStreaming()))
+        {
+            quadBatchCount = instancedQuadCount;
+            quadBatchMatrices = quadGrid(quadBatchCount);
+            quadBatch.setInstances(quadBatchMatrices);
+        }
+
+        // animated instances are computed on the worker threads straight into the mapped ring buffer
+        if (animateInstances && quadBatchCount > 0)
+        {
+            if (glm::mat4* dst = quadBatch.mapInstances(streamBuffer, quadBatchCount))
+            {
+                float t = (float)currentTime;
+
+                JobSystem::instance().parallelFor(quadBatchMatrices.size(), 4096, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        const glm::mat4& m = quadBatchMatrices[i];
+                        dst[i] = glm::rotate(m, 0.5f * std::sin(t * 2.0f + m[3].x + m[3].y), glm::vec3(0.0f, 0.0f, 1.0f));
+                    }
+                });
+
+                quadBatch.unmapInstances(streamBuffer);
+            }
+        }
+
+        frameUniforms.update(vMat, pMat);
+
+        // move the static quads in or out of the batch when the checkbox changes
+        if (batchStaticQuads != (staticBatch.size() > 0))
+        {
+            staticBatch.clear();
+
+            if (batchStaticQuads)
+                for (auto& q : staticQuads)
+                    staticBatch.add(q.get(), &instancedShader);
+        }
+
         // call each of the queued renderers
+        double submitStart = glfwGetTime();
+
+        profiler.push("Cull");
+
+        // bring world matrices up to date, only the edited parts of the hierarchy are touched
+        sceneGraph.update();
+
+        // everything that is drawn one by one goes through culling
+        candidates.clear();
+
+        if (showChildQuad)
+            candidates.push_back(&childQuad);
+
         for(renderer *r : renderers)
         {
-            r->render(vMat, pMat, deltaTime);
+            if (!r->isStaticBatched())
+                candidates.push_back(r);
+        }
+
+        if (showStaticQuads)
+            for (auto& q : staticQuads)
+                if (!q->isStaticBatched())
+                    candidates.push_back(q.get());
+
+        if (frustumCulling)
+        {
+            G4G_TRACE_SCOPE("Cull");
+            boundsTree.setObjects(candidates); // rebuilds only if the list changed
+            boundsTree.update();               // refits objects that moved
+
+            visible.clear();
+            boundsTree.query(Frustum(pMat * vMat), visible);
+        }
+        else
+            visible = candidates;
+
+        cullCandidateCount = (unsigned int)candidates.size();
+        visibleCount = (unsigned int)visible.size();
+
+        profiler.pop();
+        profiler.push("Submit");
+
+        // the per object matrix products run on the worker threads, the GL thread only issues the draws
+        glm::mat4 viewProjection = pMat * vMat;
+
+        JobSystem::instance().parallelFor(visible.size(), 1024, [&](size_t begin, size_t end) {
+            G4G_TRACE_SCOPE("updateMVP");
+            for (size_t i = begin; i < end; i++)
+                visible[i]->updateMVP(viewProjection);
+        });
+
+        {
+            G4G_TRACE_SCOPE("RenderQueue");
+            renderQueue.clear();
+
+            for (renderer* r : visible)
+                renderQueue.submit(r, vMat);
+
+            renderQueue.sort();
+            renderQueue.execute(vMat, pMat);
+        }
+
+        profiler.pop();
+
+        if (showStaticQuads)
+        {
+            G4G_PROFILE_SCOPE(profiler, "Static batch");
+            staticBatch.render(vMat, pMat);
+        }
+
+        // last, so the depth test rejects every sky pixel the scene already covers
+        if (showSkybox)
+        {
+            G4G_PROFILE_SCOPE(profiler, "Skybox");
+            skybox.render(vMat, pMat, deltaTime);
+        }
+
+        sceneDrawCount = renderQueue.stats.draws + (showStaticQuads ? (unsigned int)staticBatch.size() : 0);
+        sceneSubmitMs = 0.95 * sceneSubmitMs + 0.05 * 1000.0 * (glfwGetTime() - submitStart);
+
+        streamBuffer.endFrame();
+
+        profiler.pop(); // Scene
+
+        if (headless.enabled)
+        {
+            profiler.endFrame();
+            frameTimings->endFrame(1000.0 * (glfwGetTime() - frameStart));
+
+            if (!headless.dumpDir.empty() && frame % headless.dumpEvery == 0)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "frame_%04d.png", frame);
+                offscreen->dumpPNG((fs::path(headless.dumpDir) / name).string());
+            }
+
+            frame++;
+            continue;
         }
 
         // draw imGui over the top
-        drawIMGUI(&ourShader,&myQuad);
+        drawIMGUI(&ourShader,&myQuad,&profiler,&textureLoader);
+
+        profiler.endFrame();
 
-        glfwSwapBuffers(window);
+        {
+            G4G_TRACE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+    }
+
+    if (headless.enabled)
+    {
+        frameTimings->report(headless.csvPath);
+
+#ifdef G4G_TRACE
+        if (!headless.tracePath.empty())
+            trace::dumpChromeJSON(headless.tracePath);
+#endif
+
+        frameTimings.reset();
+        offscreen.reset();
     }
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
     return 0;
 }
 
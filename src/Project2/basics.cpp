@@ -1,5 +1,16 @@
+#include "dirty_tiles.h"
+#include "image.h"
+#include "image_file.h"
+#include "procedural_texture.h"
+#include "software_rasterizer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <fstream>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <list>
 
@@ -10,27 +21,308 @@ struct myEvent {
 
 using namespace std;
 
-constexpr auto dimx = 512u, dimy = 512u;
+// the pixel buffer behind the texture, RGBA8 so every row is 4 byte aligned and uploads stay on GL's fast path
+Image imageBuff(512, 512, PixelFormat::RGBA8);
+DirtyTiles imageDirty(512, 512); // tiles of imageBuff written since the last upload
+
+// reallocate imageBuff (cleared), the texture has to be reallocated to match
+int resizeImage(int width, int height, PixelFormat format, ImageLayout layout)
+{
+	imageBuff.resize(width, height, format, layout);
+	imageDirty.resize(width, height);
+	imageDirty.markAll();
+
+	return 0;
+}
+
+// the generators below write 8 bit linear pixels, other formats and layouts get a converted copy of their output
+template<class Draw> static void drawBytes(Draw draw)
+{
+	bool direct = imageBuff.linear() && (imageBuff.format() == PixelFormat::RGB8 || imageBuff.format() == PixelFormat::RGBA8);
+
+	if (direct)
+		draw(imageBuff);
+	else
+	{
+		static Image scratch;
+		if (scratch.width() != imageBuff.width() || scratch.height() != imageBuff.height())
+			scratch.resize(imageBuff.width(), imageBuff.height(), PixelFormat::RGBA8);
+
+		draw(scratch);
+		imageBuff.view().copyFrom(scratch.view());
+	}
+
+	imageDirty.markAll();
+}
+
+// fills imageBuff with a procedural pattern, the default Params give the original 16 pixel black and white checker
+int myTexture(const proctex::Params& params, proctex::Isa isa)
+{
+	drawBytes([&](Image& target) {
+		proctex::generate(target.data(), target.width(), target.height(), target.channels(), target.pitch(), params, isa);
+	});
+
+	return 0;
+}
+
+// a small dot wandering over imageBuff and leaving a trail, only touches a tile or two per call
+int myPaint(float time)
+{
+	const int radius = 4;
+
+	int w = imageBuff.width(), h = imageBuff.height();
+	int cx = (int)(w / 2 + (w / 2 - radius - 1) * sin(time * 1.3f));
+	int cy = (int)(h / 2 + (h / 2 - radius - 1) * sin(time * 1.7f + 0.5f));
+
+	glm::vec4 color(0.5f + 0.5f * sin(time), 0.5f + 0.5f * sin(time * 1.1f + 2.0f), 0.5f + 0.5f * sin(time * 1.2f + 4.0f), 1.0f);
+
+	ImageView dot = imageBuff.view(cx - radius, cy - radius, 2 * radius + 1, 2 * radius + 1);
+
+	for (int y = 0; y < dot.height; y++)
+		for (int x = 0; x < dot.width; x++)
+		{
+			int dx = dot.x + x - cx, dy = dot.y + y - cy;
+			if (dx * dx + dy * dy <= radius * radius)
+				dot.store(x, y, color);
+		}
+
+	imageDirty.mark(dot.x, dot.y, dot.width, dot.height);
 
-unsigned char imageBuff[dimx][dimy][3];
+	return 0;
+}
 
-int myTexture() 
+// a field of cubes with a color per corner, roughly 12 triangles per cube
+static void cubeField(int cubes, vector<swr::Vertex>& vertices, vector<uint32_t>& indices)
 {
-	memset(imageBuff, 0, sizeof(imageBuff));
+	static const uint32_t faces[36] = {
+		0,2,1, 1,2,3,  4,5,6, 5,7,6,  0,1,4, 1,5,4,  2,6,3, 3,6,7,  0,4,2, 2,4,6,  1,3,5, 3,7,5 };
+
+	int side = max(1, (int)ceil(sqrt((float)cubes)));
+
+	vertices.clear();
+	indices.clear();
 
-	for (int i = 0; i < dimx; i++)
-		for (int j = 0; j < dimy; j++)
+	for (int c = 0; c < cubes; c++)
+	{
+		glm::vec3 center((c % side) - side * 0.5f + 0.5f, 0.0f, -(float)(c / side) - 2.0f);
+		uint32_t base = (uint32_t)vertices.size();
+
+		for (int corner = 0; corner < 8; corner++)
 		{
-			if (((i / 16) % 2) == 0)
+			swr::Vertex v;
+			glm::vec3 offset((corner & 1) ? 0.3f : -0.3f, (corner & 2) ? 0.3f : -0.3f, (corner & 4) ? 0.3f : -0.3f);
+			v.position = center + offset;
+			v.varyings[0] = (corner & 1) ? 1.0f : 0.2f;
+			v.varyings[1] = (corner & 2) ? 1.0f : 0.2f;
+			v.varyings[2] = (corner & 4) ? 1.0f : 0.2f;
+			vertices.push_back(v);
+		}
+
+		for (uint32_t i : faces)
+			indices.push_back(base + i);
+	}
+}
+
+static glm::mat4 cubeFieldMVP(float angle, int cubes, float aspect)
+{
+	float depth = (float)max(1, (int)ceil(sqrt((float)cubes)));
+
+	glm::mat4 p = glm::perspective(1.0472f, aspect, 0.1f, depth + 10.0f);
+	glm::mat4 v = glm::lookAt(glm::vec3(0.0f, depth * 0.4f + 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, -depth * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	return p * v * glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// draw the cube field into imageBuff with the software rasterizer
+int myRaster(float angle, int cubes)
+{
+	static swr::Rasterizer raster;
+	static vector<swr::Vertex> vertices;
+	static vector<uint32_t> indices;
+
+	if (indices.size() != (size_t)cubes * 36)
+		cubeField(cubes, vertices, indices);
+
+	drawBytes([&](Image& target) {
+		raster.setTarget(target.data(), target.width(), target.height(), (int)target.pitch(), target.channels());
+		raster.clear(glm::vec3(0.1f, 0.1f, 0.15f));
+		raster.cullBackFaces = true;
+		raster.draw(vertices, indices, cubeFieldMVP(angle, cubes, (float)target.width() / target.height()));
+	});
+
+	return 0;
+}
+
+// throughput of the software rasterizer, no window or GL needed (--bench-raster)
+int rasterBenchmark(int frames, int triangles)
+{
+	int cubes = max(1, triangles / 12);
+
+	vector<swr::Vertex> vertices;
+	vector<uint32_t> indices;
+	cubeField(cubes, vertices, indices);
+
+	Image target(512, 512, PixelFormat::RGBA8);
+
+	swr::Rasterizer raster;
+	raster.setTarget(target.data(), target.width(), target.height(), (int)target.pitch(), target.channels());
+	raster.cullBackFaces = true;
+
+	vector<double> ms;
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		auto start = chrono::steady_clock::now();
+
+		raster.clear(glm::vec3(0.0f));
+		raster.draw(vertices, indices, cubeFieldMVP(frame * 0.01f, cubes, 1.0f));
+
+		ms.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	}
+
+	double total = 0.0;
+	for (double m : ms)
+		total += m;
+
+	sort(ms.begin(), ms.end());
+
+	printf("software raster (%s, %u threads): %d x %d, %zu triangles, %d frames\n", swr::simdName(),
+		JobSystem::instance().threadCount() + 1, target.width(), target.height(), indices.size() / 3, frames);
+	printf("  ms/frame: avg %.3f  min %.3f  median %.3f\n", total / frames, ms.front(), ms[ms.size() / 2]);
+	printf("  %.2f Mtriangles/s  %.2f Mpixels/s  (%zu triangles set up, %zu tiles, %zu pixels written per frame)\n",
+		raster.stats.triangles / (total * 1000.0), raster.stats.pixels / (total * 1000.0),
+		raster.stats.setup / frames, raster.stats.tiles / frames, raster.stats.pixels / frames);
+
+	return 0;
+}
+
+// times every pattern at 4K RGBA on each instruction set this CPU has
+int textureBenchmark(int frames)
+{
+	const int width = 3840, height = 2160;
+	vector<uint8_t> pixels((size_t)width * height * 4);
+
+	printf("procedural texture (%u threads): %d x %d RGBA, %d frames, best ISA %s\n",
+		JobSystem::instance().threadCount() + 1, width, height, frames, proctex::isaName(proctex::bestIsa()));
+
+	for (int pattern = 0; pattern <= (int)proctex::Pattern::Voronoi; pattern++)
+	{
+		proctex::Params params;
+		params.pattern = (proctex::Pattern)pattern;
+		params.scale = pattern <= (int)proctex::Pattern::Gradient ? 16.0f : 128.0f;
+
+		printf("  %-14s", proctex::patternName(params.pattern));
+
+		for (int isa = 0; isa <= (int)proctex::bestIsa(); isa++)
+		{
+			auto start = chrono::steady_clock::now();
+
+			for (int frame = 0; frame < frames; frame++)
+				proctex::generate(pixels.data(), width, height, 4, (size_t)width * 4, params, (proctex::Isa)isa);
+
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frames;
+			printf("  %s %8.2f ms", proctex::isaName((proctex::Isa)isa), ms);
+		}
+
+		printf("\n");
+	}
+
+	return 0;
+}
+
+// decode time of every file with the extension in data/ and data/cubeMap/ per SIMD tier, limit sets the tier for
+// that format (stbi_jpeg_simd_limit, stbi_png_simd_limit) and returns the one actually used. true if all tiers match C.
+// the limits are unsynchronized globals in stb, so this has to run before any TextureLoader or CubeMapTexture job
+// starts decoding (main() calls it ahead of glfwInit). comparing against the decoder before the SIMD work, and
+// timing the inflate changes that have no tier switch, is tools/stb_image_diff/'s job, this only checks the tiers
+// against each other
+static bool decodeBenchmarkFormat(const char* format, const char* extension, int (*limit)(int), int runs)
+{
+	static const char* tierNames[] = { "C", "SSE2", "AVX2" };
+
+	vector<string> paths;
+	for (const char* dir : { "data", "data/cubeMap" })
+	{
+		error_code ec;
+		for (const filesystem::directory_entry& e : filesystem::directory_iterator(dir, ec))
+			if (e.path().extension() == extension)
+				paths.push_back(e.path().generic_string());
+	}
+	sort(paths.begin(), paths.end());
+
+	int best = limit(2);
+
+	printf("%s decode: %zu files, %d runs, best tier %s\n", format, paths.size(), runs, tierNames[best]);
+
+	vector<double> totals(best + 1, 0.0);
+	double pixels = 0.0;
+	bool identical = true;
+
+	for (const string& path : paths)
+	{
+		string bytes;
+		if (!readFileBytes(path, bytes))
+			continue;
+
+		printf("  %-24s", path.c_str());
+
+		DecodedImage reference;
+
+		for (int tier = 0; tier <= best; tier++)
+		{
+			limit(tier);
+
+			double fastest = 1e9;
+			DecodedImage image;
+
+			for (int run = 0; run < runs; run++)
 			{
-				if (((j / 16) % 2) == 0)
-					imageBuff[i][j][0] = imageBuff[i][j][1] = imageBuff[i][j][2] = 255;
+				auto start = chrono::steady_clock::now();
+				image = decodeImage(bytes.data(), bytes.size());
+				fastest = min(fastest, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
 			}
-			else {
-				if (((j / 16) % 2) == 1)
-					imageBuff[i][j][0] = imageBuff[i][j][1] = imageBuff[i][j][2] = 255;
+
+			if (!image)
+			{
+				printf("  %s failed (%s)", tierNames[tier], image.reason.c_str());
+				continue;
 			}
+
+			if (tier == 0)
+			{
+				pixels += (double)image.width * image.height;
+				reference = move(image);
+			}
+			else if (!reference || reference.sizeBytes() != image.sizeBytes() ||
+				memcmp(reference.pixels.get(), image.pixels.get(), reference.sizeBytes()) != 0)
+			{
+				printf(" DIFFERS");
+				identical = false;
+			}
+
+			totals[tier] += fastest;
+			printf("  %s %7.2f ms", tierNames[tier], fastest);
 		}
 
-	return 0;
-}
\ No newline at end of file
+		printf("\n");
+	}
+
+	limit(2);
+
+	printf("  total");
+	for (int tier = 0; tier <= best; tier++)
+		printf("  %s %7.2f ms (%.1f Mpixels/s)", tierNames[tier], totals[tier], pixels / (totals[tier] * 1000.0));
+	printf("\n  %s\n", identical ? "all tiers match the C decoder" : "MISMATCH between tiers");
+
+	return identical;
+}
+
+// JPEG and PNG decode time per SIMD tier of stb_image, the way the texture loaders decode (--bench-decode)
+// every tier has to produce the same bytes as the plain C one
+int decodeBenchmark(int runs)
+{
+	bool jpeg = decodeBenchmarkFormat("jpeg", ".jpg", stbi_jpeg_simd_limit, runs);
+	bool png = decodeBenchmarkFormat("png", ".png", stbi_png_simd_limit, runs);
+
+	return jpeg && png ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+#pragma once
+// axis aligned bounding box
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    void grow(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void grow(const AABB& b)
+    {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    // box around this box after transforming it by m (Arvo's method, transforms center and extent instead of all 8 corners)
+    AABB transformed(const glm::mat4& m) const
+    {
+        if (isEmpty())
+            return *this;
+
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extent();
+
+        glm::vec3 r;
+        for (int i = 0; i < 3; i++)
+            r[i] = glm::abs(m[0][i]) * e.x + glm::abs(m[1][i]) * e.y + glm::abs(m[2][i]) * e.z;
+
+        AABB out;
+        out.min = c - r;
+        out.max = c + r;
+        return out;
+    }
+};
@@ -0,0 +1,142 @@
+#include <glad/glad.h>
+
+#include "image_file.h"
+#include "job_system.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#pragma once
+// a cube map texture from six image files, e.g. data/cubeMap/xp.jpg ... zn.jpg
+//
+// the faces are read and decoded at the same time, one per job system worker, then uploaded into immutable storage
+// (glTexStorage2D, or glTexImage2D per level where ARB_texture_storage is missing) with a full mip chain.
+// seamless filtering is switched on so the mip levels don't show the seams between faces
+class CubeMapTexture {
+
+    unsigned int id = 0;
+    int faceSize = 0;
+
+public:
+    // GL's face order: +X, -X, +Y, -Y, +Z, -Z
+    static inline const char* faceNames[6] = { "xp", "xn", "yp", "yn", "zp", "zn" };
+
+    CubeMapTexture() {}
+
+    // directory/xp.jpg etc., see load()
+    explicit CubeMapTexture(const std::string& directory, const std::string& extension = ".jpg")
+    {
+        load(directory, extension);
+    }
+
+    ~CubeMapTexture()
+    {
+        if (id)
+            glDeleteTextures(1, &id);
+    }
+
+    CubeMapTexture(const CubeMapTexture&) = delete;
+    CubeMapTexture& operator=(const CubeMapTexture&) = delete;
+
+    unsigned int texture() const { return id; }
+    int size() const { return faceSize; }
+    explicit operator bool() const { return id != 0; }
+
+    // GL thread, blocks until all six faces are decoded (and helps decoding them). false if a face is missing,
+    // can't be decoded or doesn't match the others (faces have to be square and all the same size)
+    bool load(const std::string& directory, const std::string& extension = ".jpg")
+    {
+        G4G_TRACE_SCOPE("CubeMapTexture::load");
+
+        std::string paths[6];
+        DecodedImage faces[6];
+
+        for (int i = 0; i < 6; i++)
+            paths[i] = directory + "/" + faceNames[i] + extension;
+
+        JobSystem::instance().parallelFor(6, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                G4G_TRACE_SCOPE("CubeMapTexture face");
+
+                // cube map faces are not flipped, GL expects their first row at the top
+                faces[i] = loadImageFile(paths[i]);
+            }
+        });
+
+        bool ok = true;
+
+        for (int i = 0; i < 6; i++)
+        {
+            const DecodedImage& f = faces[i];
+
+            if (!f)
+                std::cout << "ERROR::CUBEMAP::LOAD_FAILED " << paths[i] << ": " << imageLoadErrorName(f.error) << " (" << f.reason << ")" << std::endl;
+            else if (f.width != f.height || f.width != faces[0].width || f.channels != faces[0].channels)
+                std::cout << "ERROR::CUBEMAP::FACE_MISMATCH " << paths[i] << " is " << f.width << "x" << f.height << "x" << f.channels << std::endl;
+            else
+                continue;
+
+            ok = false;
+        }
+
+        if (ok)
+            upload(faces[0].width, faces[0].channels, [&](int i) { return faces[i].pixels.get(); });
+
+        return ok;
+    }
+
+private:
+    template<class Pixels>
+    void upload(int size, int channels, Pixels facePixels)
+    {
+        static const GLenum internalFormats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+        static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+        if (id)
+            glDeleteTextures(1, &id);
+
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+
+        faceSize = size;
+
+        int levels = 1;
+        while ((size >> levels) > 0)
+            levels++;
+
+        GLenum internalFormat = internalFormats[channels - 1], format = formats[channels - 1];
+
+        if (GLAD_GL_ARB_texture_storage && glTexStorage2D)
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, internalFormat, size, size);
+        else
+        {
+            // mutable storage, complete because every level of every face is specified
+            for (int level = 0; level < levels; level++)
+                for (int face = 0; face < 6; face++)
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internalFormat, std::max(size >> level, 1),
+                        std::max(size >> level, 1), 0, format, GL_UNSIGNED_BYTE, NULL);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows of any width
+
+        for (int face = 0; face < 6; face++)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, size, size, format, GL_UNSIGNED_BYTE, facePixels(face));
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        // filtering across face edges, for every cube map in the context (core since 3.2)
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    }
+};
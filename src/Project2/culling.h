@@ -0,0 +1,266 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define G4G_CULL_SSE 1
+#endif
+
+#pragma once
+// the six clip planes of a view frustum, stored structure-of-arrays so 4 planes can be tested against a box at once
+// (padded to 8 with copies of the first plane)
+class Frustum {
+
+public:
+    alignas(16) float nx[8], ny[8], nz[8], d[8];
+
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    // planes straight out of the combined matrix (Gribb & Hartmann), normals point into the frustum
+    explicit Frustum(const glm::mat4& vp)
+    {
+        glm::vec4 planes[6];
+
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 row(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+            glm::vec4 w(vp[0][3], vp[1][3], vp[2][3], vp[3][3]);
+
+            planes[i * 2 + 0] = w + row;
+            planes[i * 2 + 1] = w - row;
+        }
+
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 p = planes[i < 6 ? i : 0];
+
+            float len = glm::length(glm::vec3(p));
+            if (len > 0.0f)
+                p /= len;
+
+            nx[i] = p.x; ny[i] = p.y; nz[i] = p.z; d[i] = p.w;
+        }
+    }
+
+    // box given as center and half extent
+    Result test(const glm::vec3& c, const glm::vec3& e) const
+    {
+#ifdef G4G_CULL_SSE
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+
+        __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+
+        int outside = 0, intersects = 0;
+
+        for (int i = 0; i < 8; i += 4)
+        {
+            __m128 px = _mm_load_ps(nx + i), py = _mm_load_ps(ny + i), pz = _mm_load_ps(nz + i), pd = _mm_load_ps(d + i);
+
+            // signed distance of the center and the box's projected radius onto each plane normal
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), pd));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)),
+                _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+            intersects |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), _mm_setzero_ps()));
+        }
+
+        if (outside)
+            return OUTSIDE;
+
+        return intersects ? INTERSECTS : INSIDE;
+#else
+        Result result = INSIDE;
+
+        for (int i = 0; i < 6; i++)
+        {
+            float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+            float radius = std::abs(nx[i]) * e.x + std::abs(ny[i]) * e.y + std::abs(nz[i]) * e.z;
+
+            if (dist + radius < 0.0f)
+                return OUTSIDE;
+            if (dist - radius < 0.0f)
+                result = INTERSECTS;
+        }
+
+        return result;
+#endif
+    }
+};
+
+// bounding volume hierarchy over renderers, used to cut the render list down to what the camera can see
+//
+// build() splits the objects top down at the median of the longest axis. after that, update() only refits the
+// leaves whose renderer changed its transform (see renderer::getTransformVersion) and the nodes above them,
+// a full rebuild only happens when the set of objects changes
+class BoundsTree {
+
+    struct Node {
+        AABB box;
+        int parent = -1;
+        int left = -1, right = -1; // children, -1 for leaves
+        int object = -1;           // index into objects for leaves
+        bool dirty = false;
+    };
+
+    std::vector<Node> nodes; // parents always come before their children
+    std::vector<renderer*> objects;
+    std::vector<int> leafOf;               // node index of each object's leaf
+    std::vector<unsigned int> versions;    // transform version each leaf was built from
+    std::vector<renderer*> unbounded;      // objects without bounds, always visible
+
+public:
+    unsigned int refitCount = 0; // leaves refit by the last update()
+
+    // rebuilds only when the list differs from the last one
+    void setObjects(const std::vector<renderer*>& list)
+    {
+        std::vector<renderer*> bounded, noBounds;
+
+        for (renderer* r : list)
+            (r->hasBounds() ? bounded : noBounds).push_back(r);
+
+        if (bounded == objects && noBounds == unbounded)
+            return;
+
+        objects = bounded;
+        unbounded = noBounds;
+        build();
+    }
+
+    void build()
+    {
+        nodes.clear();
+        leafOf.assign(objects.size(), -1);
+        versions.assign(objects.size(), 0);
+
+        if (objects.empty())
+            return;
+
+        std::vector<AABB> boxes(objects.size());
+        std::vector<int> order(objects.size());
+
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            boxes[i] = objects[i]->worldBounds();
+            versions[i] = objects[i]->getTransformVersion();
+            order[i] = (int)i;
+        }
+
+        nodes.reserve(objects.size() * 2);
+        buildNode(boxes, order, 0, (int)order.size(), -1);
+    }
+
+    // refit the leaves of objects that moved, then their ancestors
+    void update()
+    {
+        refitCount = 0;
+
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            if (objects[i]->getTransformVersion() == versions[i])
+                continue;
+
+            versions[i] = objects[i]->getTransformVersion();
+
+            int n = leafOf[i];
+            nodes[n].box = objects[i]->worldBounds();
+            refitCount++;
+
+            for (int p = nodes[n].parent; p >= 0 && !nodes[p].dirty; p = nodes[p].parent)
+                nodes[p].dirty = true;
+        }
+
+        if (!refitCount)
+            return;
+
+        // children come after their parents, so walking backwards refits bottom up
+        for (int n = (int)nodes.size() - 1; n >= 0; n--)
+        {
+            Node& node = nodes[n];
+            if (!node.dirty)
+                continue;
+
+            node.box = nodes[node.left].box;
+            node.box.grow(nodes[node.right].box);
+            node.dirty = false;
+        }
+    }
+
+    // append everything that can be visible through the frustum
+    void query(const Frustum& frustum, std::vector<renderer*>& visible) const
+    {
+        visible.insert(visible.end(), unbounded.begin(), unbounded.end());
+
+        if (!nodes.empty())
+            queryNode(frustum, 0, false, visible);
+    }
+
+    size_t size() const { return objects.size() + unbounded.size(); }
+
+private:
+    int buildNode(const std::vector<AABB>& boxes, std::vector<int>& order, int first, int last, int parent)
+    {
+        int index = (int)nodes.size();
+        nodes.push_back(Node());
+        nodes[index].parent = parent;
+
+        AABB box, centers;
+        for (int i = first; i < last; i++)
+        {
+            box.grow(boxes[order[i]]);
+            centers.grow(boxes[order[i]].center());
+        }
+        nodes[index].box = box;
+
+        if (last - first == 1)
+        {
+            nodes[index].object = order[first];
+            leafOf[order[first]] = index;
+            return index;
+        }
+
+        // split at the median along the axis where the centers are spread the most
+        glm::vec3 spread = centers.max - centers.min;
+        int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+
+        int mid = (first + last) / 2;
+        std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + last,
+            [&](int a, int b) { return boxes[a].center()[axis] < boxes[b].center()[axis]; });
+
+        int left = buildNode(boxes, order, first, mid, index);
+        int right = buildNode(boxes, order, mid, last, index);
+
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    void queryNode(const Frustum& frustum, int n, bool fullyInside, std::vector<renderer*>& visible) const
+    {
+        const Node& node = nodes[n];
+
+        if (!fullyInside)
+        {
+            Frustum::Result r = frustum.test(node.box.center(), node.box.extent());
+
+            if (r == Frustum::OUTSIDE)
+                return;
+
+            fullyInside = (r == Frustum::INSIDE); // no need to test anything below this node
+        }
+
+        if (node.object >= 0)
+        {
+            visible.push_back(objects[node.object]);
+            return;
+        }
+
+        queryNode(frustum, node.left, fullyInside, visible);
+        queryNode(frustum, node.right, fullyInside, visible);
+    }
+};
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+// which parts of a CPU side image changed since it was last uploaded, kept as one dirty flag per square tile
+//
+//   dirty.mark(x, y, w, h);            after writing pixels, any rectangle, clipped to the image
+//   for (auto& r : dirty.rects()) ...  upload, then dirty.clear()
+//
+// rects() joins dirty tiles into few rectangles: runs of tiles along a row, stacked with the identical runs of the
+// rows below, so a full image comes out as one rectangle and a small brush stroke as one or two tiles.
+// not thread safe, mark from the thread that owns the image
+class DirtyTiles {
+
+    std::vector<uint8_t> tiles;
+    size_t count = 0;
+
+public:
+    struct Rect {
+        int x, y, width, height; // in pixels, clipped to the image
+    };
+
+    int width = 0, height = 0, tileSize = 0, tilesX = 0, tilesY = 0;
+
+    DirtyTiles(int w, int h, int tile = 32)
+    {
+        resize(w, h, tile);
+    }
+
+    // for a reallocated image, everything starts out clean
+    void resize(int w, int h, int tile = 32)
+    {
+        width = w;
+        height = h;
+        tileSize = tile;
+        tilesX = (w + tile - 1) / tile;
+        tilesY = (h + tile - 1) / tile;
+
+        tiles.assign((size_t)tilesX * tilesY, 0);
+        count = 0;
+    }
+
+    void mark(int x, int y, int w, int h)
+    {
+        int x0 = std::max(x, 0), y0 = std::max(y, 0);
+        int x1 = std::min(x + w, width), y1 = std::min(y + h, height);
+
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        for (int ty = y0 / tileSize; ty <= (y1 - 1) / tileSize; ty++)
+            for (int tx = x0 / tileSize; tx <= (x1 - 1) / tileSize; tx++)
+            {
+                uint8_t& t = tiles[(size_t)ty * tilesX + tx];
+                count += !t;
+                t = 1;
+            }
+    }
+
+    void markAll()
+    {
+        std::fill(tiles.begin(), tiles.end(), 1);
+        count = tiles.size();
+    }
+
+    void clear()
+    {
+        std::fill(tiles.begin(), tiles.end(), 0);
+        count = 0;
+    }
+
+    bool any() const { return count != 0; }
+    size_t dirtyCount() const { return count; }
+    size_t tileCount() const { return tiles.size(); }
+
+    std::vector<Rect> rects() const
+    {
+        std::vector<Rect> out;
+
+        if (!count)
+            return out;
+
+        // runs in tile units, the previous row's runs are still open and may grow downwards
+        struct Run { int begin, end; size_t rect; };
+        std::vector<Run> open, next;
+
+        for (int ty = 0; ty < tilesY; ty++)
+        {
+            next.clear();
+
+            for (int tx = 0; tx < tilesX; )
+            {
+                if (!tiles[(size_t)ty * tilesX + tx])
+                {
+                    tx++;
+                    continue;
+                }
+
+                int begin = tx;
+                while (tx < tilesX && tiles[(size_t)ty * tilesX + tx])
+                    tx++;
+
+                auto above = std::find_if(open.begin(), open.end(), [&](const Run& r) { return r.begin == begin && r.end == tx; });
+
+                if (above != open.end())
+                {
+                    out[above->rect].height = std::min((ty + 1) * tileSize, height) - out[above->rect].y;
+                    next.push_back(*above);
+                }
+                else
+                {
+                    int x = begin * tileSize, y = ty * tileSize;
+                    out.push_back({ x, y, std::min(tx * tileSize, width) - x, std::min(y + tileSize, height) - y });
+                    next.push_back({ begin, tx, out.size() - 1 });
+                }
+            }
+
+            open.swap(next);
+        }
+
+        return out;
+    }
+};
@@ -0,0 +1,46 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "shader_s.h"
+
+#pragma once
+// camera data that only changes once per frame, shared by every shader through one uniform buffer
+// the layout matches the std140 "Camera" block in the shaders, mat4s are already 16 byte aligned so no padding is needed
+struct CameraBlock {
+    glm::mat4 v;  // view
+    glm::mat4 p;  // perspective
+    glm::mat4 vp; // perspective * view
+};
+
+class FrameUniforms {
+
+    unsigned int UBO = 0;
+
+public: FrameUniforms()
+{
+    glGenBuffers(1, &UBO);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // every Shader points its "Camera" block at this binding point when it links
+    glBindBufferBase(GL_UNIFORM_BUFFER, Shader::CAMERA_BLOCK_BINDING, UBO);
+}
+
+public: ~FrameUniforms()
+{
+    glDeleteBuffers(1, &UBO);
+}
+
+    // one buffer update per frame, no matter how many objects get drawn
+public: void update(const glm::mat4& vMat, const glm::mat4& pMat)
+{
+    CameraBlock block = { vMat, pMat, pMat * vMat };
+
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+};
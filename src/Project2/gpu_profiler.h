@@ -0,0 +1,270 @@
+#include <glad/glad.h>
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#pragma once
+// per pass CPU and GPU timings without stalling the pipeline
+//
+// passes are bracketed with G4G_PROFILE_SCOPE(profiler, "name") and may nest. the GPU side of every scope is a pair
+// of GL_TIMESTAMP queries (elapsed time queries can't nest), the CPU side uses the high resolution clock.
+// queries are kept per frame for FRAME_LATENCY frames and only read back once the GPU has finished with them,
+// so a frame's GPU numbers show up a few frames later instead of forcing a sync
+class GpuProfiler {
+
+public:
+    static const int FRAME_LATENCY = 4;
+    static const int GRAPH_SIZE = 240;
+    static const int CSV_HISTORY = 600;
+
+    struct Result {
+        std::string name;
+        int depth;
+        double cpuMs, gpuMs;
+    };
+
+private:
+    struct Scope {
+        const char* name;
+        int depth;
+        double cpuBegin, cpuEnd;
+        unsigned int queryBegin, queryEnd;
+    };
+
+    struct Frame {
+        std::vector<Scope> scopes;
+        std::vector<unsigned int> queries;
+        size_t queriesUsed = 0;
+        unsigned long long index = 0;
+        bool pending = false;
+    };
+
+    Frame frames[FRAME_LATENCY];
+    int current = 0;
+    unsigned long long frameCounter = 0;
+    std::vector<int> stack; // open scopes of the current frame
+
+    std::vector<Result> latest; // most recent frame whose queries came back
+    std::deque<std::pair<unsigned long long, std::vector<Result>>> history;
+
+    float cpuGraph[GRAPH_SIZE] = {}, gpuGraph[GRAPH_SIZE] = {};
+    int graphPos = 0;
+
+public:
+    bool enabled = true;
+    unsigned int droppedFrames = 0; // frames whose queries weren't ready when their slot came around again
+
+    ~GpuProfiler()
+    {
+        for (Frame& f : frames)
+            if (!f.queries.empty())
+                glDeleteQueries((GLsizei)f.queries.size(), f.queries.data());
+    }
+
+    void beginFrame()
+    {
+        current = (current + 1) % FRAME_LATENCY;
+        Frame& f = frames[current];
+
+        // this slot was last used FRAME_LATENCY frames ago, its results should be ready by now
+        if (f.pending)
+            resolve(f);
+
+        f.scopes.clear();
+        f.queriesUsed = 0;
+        f.index = frameCounter++;
+        f.pending = enabled;
+        stack.clear();
+    }
+
+    void endFrame()
+    {
+        while (!stack.empty())
+            pop();
+    }
+
+    void push(const char* name)
+    {
+        Frame& f = frames[current];
+
+        // enabled is only looked at in beginFrame(), so toggling it mid frame can't leave scopes half open
+        if (!f.pending)
+            return;
+
+        Scope s;
+        s.name = name;
+        s.depth = (int)stack.size();
+        s.cpuBegin = now();
+        s.cpuEnd = s.cpuBegin;
+        s.queryBegin = nextQuery(f);
+        s.queryEnd = 0;
+
+        glQueryCounter(s.queryBegin, GL_TIMESTAMP);
+
+        stack.push_back((int)f.scopes.size());
+        f.scopes.push_back(s);
+    }
+
+    void pop()
+    {
+        if (stack.empty())
+            return;
+
+        Frame& f = frames[current];
+        Scope& s = f.scopes[stack.back()];
+        stack.pop_back();
+
+        s.queryEnd = nextQuery(f);
+        glQueryCounter(s.queryEnd, GL_TIMESTAMP);
+        s.cpuEnd = now();
+    }
+
+    const std::vector<Result>& results() const { return latest; }
+
+    // hierarchical table of the latest results, rolling graphs of the frame totals and the CSV export button
+    void drawUI()
+    {
+        ImGui::Checkbox("Profile", &enabled);
+        ImGui::SameLine();
+        if (ImGui::Button("Export CSV"))
+            exportCSV("profile.csv");
+        ImGui::SameLine();
+        ImGui::Text("(%u frames dropped)", droppedFrames);
+
+        if (ImGui::BeginTable("passes", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Pass");
+            ImGui::TableSetupColumn("CPU ms");
+            ImGui::TableSetupColumn("GPU ms");
+            ImGui::TableHeadersRow();
+
+            for (const Result& r : latest)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%*s%s", r.depth * 2, "", r.name.c_str());
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%.3f", r.cpuMs);
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.3f", r.gpuMs);
+            }
+
+            ImGui::EndTable();
+        }
+
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "CPU %.2f ms", cpuGraph[(graphPos + GRAPH_SIZE - 1) % GRAPH_SIZE]);
+        ImGui::PlotLines("##cpu", cpuGraph, GRAPH_SIZE, graphPos, overlay, 0.0f, FLT_MAX, ImVec2(-FLT_MIN, 50));
+
+        snprintf(overlay, sizeof(overlay), "GPU %.2f ms", gpuGraph[(graphPos + GRAPH_SIZE - 1) % GRAPH_SIZE]);
+        ImGui::PlotLines("##gpu", gpuGraph, GRAPH_SIZE, graphPos, overlay, 0.0f, FLT_MAX, ImVec2(-FLT_MIN, 50));
+    }
+
+    // every pass of the last CSV_HISTORY resolved frames
+    bool exportCSV(const std::string& path) const
+    {
+        std::ofstream csv(path);
+        if (!csv)
+            return false;
+
+        csv << "frame,pass,depth,cpu_ms,gpu_ms\n";
+
+        for (auto& frame : history)
+            for (const Result& r : frame.second)
+                csv << frame.first << ',' << r.name << ',' << r.depth << ',' << r.cpuMs << ',' << r.gpuMs << '\n';
+
+        std::cout << "Wrote profile to " << path << std::endl;
+        return true;
+    }
+
+private:
+    static double now()
+    {
+        using namespace std::chrono;
+        return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    unsigned int nextQuery(Frame& f)
+    {
+        if (f.queriesUsed == f.queries.size())
+        {
+            size_t grow = std::max<size_t>(16, f.queries.size());
+            f.queries.resize(f.queries.size() + grow);
+            glGenQueries((GLsizei)grow, f.queries.data() + f.queriesUsed);
+        }
+
+        return f.queries[f.queriesUsed++];
+    }
+
+    void resolve(Frame& f)
+    {
+        f.pending = false;
+
+        // never wait, if the GPU is still behind the frame is simply dropped
+        for (size_t i = 0; i < f.queriesUsed; i++)
+        {
+            int available = 0;
+            glGetQueryObjectiv(f.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (!available)
+            {
+                droppedFrames++;
+                return;
+            }
+        }
+
+        latest.clear();
+
+        double cpuTotal = 0.0, gpuTotal = 0.0;
+
+        for (const Scope& s : f.scopes)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(s.queryBegin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(s.queryEnd, GL_QUERY_RESULT, &end);
+
+            Result r;
+            r.name = s.name;
+            r.depth = s.depth;
+            r.cpuMs = s.cpuEnd - s.cpuBegin;
+            r.gpuMs = end > begin ? (end - begin) / 1.0e6 : 0.0;
+            latest.push_back(r);
+
+            if (s.depth == 0)
+            {
+                cpuTotal += r.cpuMs;
+                gpuTotal += r.gpuMs;
+            }
+        }
+
+        cpuGraph[graphPos] = (float)cpuTotal;
+        gpuGraph[graphPos] = (float)gpuTotal;
+        graphPos = (graphPos + 1) % GRAPH_SIZE;
+
+        history.emplace_back(f.index, latest);
+        if (history.size() > CSV_HISTORY)
+            history.pop_front();
+    }
+};
+
+// brackets the enclosing block as one pass
+class ProfileScope {
+    GpuProfiler& profiler;
+
+public:
+    ProfileScope(GpuProfiler& p, const char* name) : profiler(p) { profiler.push(name); }
+    ~ProfileScope() { profiler.pop(); }
+};
+
+#define G4G_PROFILE_CONCAT2(a, b) a##b
+#define G4G_PROFILE_CONCAT(a, b) G4G_PROFILE_CONCAT2(a, b)
+#define G4G_PROFILE_SCOPE(profiler, name) ProfileScope G4G_PROFILE_CONCAT(profileScope, __LINE__)(profiler, name)
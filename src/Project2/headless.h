@@ -0,0 +1,218 @@
+#include <glad/glad.h>
+
+#include "png_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#pragma once
+// command line options for running without a visible window, e.g. on CI boxes with Mesa llvmpipe:
+//
+//   g4g2 --headless --frames 500 --csv timings.csv --dump frames --instances 100000
+//
+//   --headless          render into an offscreen framebuffer of an invisible window, then exit
+//   --frames N          number of frames to render (default 300)
+//   --dump DIR          write every frame to DIR/frame_0000.png ...
+//   --dump-every N      only dump every Nth frame
+//   --csv FILE          per frame CPU/GPU timings (otherwise only the summary is printed)
+//   --trace FILE        write the recorded trace events as Chrome trace JSON on exit (builds with G4G_TRACE)
+//   --egl / --osmesa    create the context through EGL or OSMesa instead of the native API (surfaceless setups)
+//   --bench-raster N    time N frames of the software rasterizer (no window or GL needed), then exit
+//   --raster-triangles N  triangles per frame for --bench-raster (default 100000)
+//   --bench-texture N   time N 4K generations of every procedural texture pattern per instruction set, then exit
+//   --bench-decode N    time N decodes of every JPEG and PNG in data/ and data/cubeMap/ per SIMD tier of stb_image, then exit
+//   --instances N       scene setup, same as the imGui controls
+//   --animate, --static-quads, --batch, --no-cull
+struct HeadlessOptions {
+    bool enabled = false;
+    int frames = 300;
+    std::string dumpDir;
+    int dumpEvery = 1;
+    std::string csvPath;
+    std::string tracePath;
+    int rasterBenchFrames = 0;
+    int rasterBenchTriangles = 100000;
+    int textureBenchFrames = 0;
+    int decodeBenchRuns = 0;
+    bool egl = false;
+    bool osmesa = false;
+
+    // scene setup
+    int instances = 0;
+    bool animate = false;
+    bool staticQuads = false;
+    bool batch = false;
+    bool cull = true;
+
+    static HeadlessOptions parse(int argc, char** argv)
+    {
+        HeadlessOptions o;
+
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+
+            if (arg == "--headless") o.enabled = true;
+            else if (arg == "--frames" && hasValue) o.frames = std::max(1, atoi(argv[++i]));
+            else if (arg == "--dump" && hasValue) o.dumpDir = argv[++i];
+            else if (arg == "--dump-every" && hasValue) o.dumpEvery = std::max(1, atoi(argv[++i]));
+            else if (arg == "--csv" && hasValue) o.csvPath = argv[++i];
+            else if (arg == "--trace" && hasValue) o.tracePath = argv[++i];
+            else if (arg == "--bench-raster" && hasValue) o.rasterBenchFrames = std::max(1, atoi(argv[++i]));
+            else if (arg == "--raster-triangles" && hasValue) o.rasterBenchTriangles = std::max(12, atoi(argv[++i]));
+            else if (arg == "--bench-texture" && hasValue) o.textureBenchFrames = std::max(1, atoi(argv[++i]));
+            else if (arg == "--bench-decode" && hasValue) o.decodeBenchRuns = std::max(1, atoi(argv[++i]));
+            else if (arg == "--egl") o.egl = true;
+            else if (arg == "--osmesa") o.osmesa = true;
+            else if (arg == "--instances" && hasValue) o.instances = std::max(0, atoi(argv[++i]));
+            else if (arg == "--animate") o.animate = true;
+            else if (arg == "--static-quads") o.staticQuads = true;
+            else if (arg == "--batch") o.batch = true;
+            else if (arg == "--no-cull") o.cull = false;
+            else
+                std::cout << "Ignoring unknown argument " << arg << '\n';
+        }
+
+        return o;
+    }
+};
+
+// color + depth framebuffer to render into when there is no window to show
+class OffscreenTarget {
+
+    unsigned int FBO = 0, colorTex = 0, depthRB = 0;
+
+public:
+    const int width, height;
+
+    OffscreenTarget(int w, int h) : width(w), height(h)
+    {
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenTextures(1, &colorTex);
+        glBindTexture(GL_TEXTURE_2D, colorTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+
+        glGenRenderbuffers(1, &depthRB);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRB);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRB);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OFFSCREEN::FRAMEBUFFER_INCOMPLETE" << std::endl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~OffscreenTarget()
+    {
+        glDeleteRenderbuffers(1, &depthRB);
+        glDeleteTextures(1, &colorTex);
+        glDeleteFramebuffers(1, &FBO);
+    }
+
+    void bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+    // read the frame back and write it top row first (GL hands it over bottom row first)
+    bool dumpPNG(const std::string& path)
+    {
+        std::vector<uint8_t> pixels((size_t)width * height * 4), flipped(pixels.size());
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        size_t row = (size_t)width * 4;
+        for (int y = 0; y < height; y++)
+            memcpy(&flipped[y * row], &pixels[(height - 1 - y) * row], row);
+
+        return png::write(path, width, height, 4, flipped.data());
+    }
+};
+
+// CPU time per frame plus GPU time from one GL_TIME_ELAPSED query per frame
+// the queries are only read back at the end, so measuring never stalls the pipeline
+class FrameTimings {
+
+    std::vector<double> cpuMs;
+    std::vector<unsigned int> queries;
+
+public:
+    explicit FrameTimings(int frames)
+    {
+        queries.resize(frames);
+        glGenQueries(frames, queries.data());
+        cpuMs.reserve(frames);
+    }
+
+    ~FrameTimings()
+    {
+        glDeleteQueries((GLsizei)queries.size(), queries.data());
+    }
+
+    void beginFrame(int frame)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+    }
+
+    void endFrame(double cpuMilliseconds)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        cpuMs.push_back(cpuMilliseconds);
+    }
+
+    // prints a summary and optionally writes every frame to a CSV file
+    void report(const std::string& csvPath)
+    {
+        glFinish();
+
+        std::vector<double> gpuMs(cpuMs.size());
+        for (size_t i = 0; i < cpuMs.size(); i++)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+            gpuMs[i] = ns / 1.0e6;
+        }
+
+        if (!csvPath.empty())
+        {
+            std::ofstream csv(csvPath);
+            csv << "frame,cpu_ms,gpu_ms\n";
+            for (size_t i = 0; i < cpuMs.size(); i++)
+                csv << i << ',' << cpuMs[i] << ',' << gpuMs[i] << '\n';
+        }
+
+        summarize("CPU", cpuMs);
+        summarize("GPU", gpuMs);
+    }
+
+private:
+    static void summarize(const char* label, std::vector<double> ms)
+    {
+        if (ms.empty())
+            return;
+
+        double sum = 0.0;
+        for (double v : ms)
+            sum += v;
+
+        std::sort(ms.begin(), ms.end());
+
+        printf("%s ms/frame: avg %.3f  min %.3f  median %.3f  p95 %.3f  max %.3f  (%zu frames)\n", label,
+            sum / ms.size(), ms.front(), ms[ms.size() / 2], ms[std::min(ms.size() - 1, ms.size() * 95 / 100)], ms.back(), ms.size());
+    }
+};
@@ -0,0 +1,250 @@
+#include <glm/glm.hpp>
+#include <glm/detail/type_half.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#pragma once
+// CPU side image of any size in one of a few pixel formats, the pixel buffer behind imageBuff
+//
+//   Image image(1024, 512, PixelFormat::RGBA8);
+//   ImageView quarter = image.view(0, 0, 512, 256);
+//   quarter.store(10, 10, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+//
+// Linear layout: top row first, every row starts on a 64 byte boundary (and a whole number of pixels from the
+// previous one, so GL can unpack it with GL_UNPACK_ROW_LENGTH).
+// Tiled layout: 8x8 pixel tiles in row order, pixels inside a tile in Morton (Z) order, so pixels that are close in
+// 2D are close in memory whichever way a loop walks. row() and pitch-based code only work on Linear images, pixel()
+// and the views work on both.
+enum class PixelFormat { RGB8, RGBA8, R32F, RGBA16F };
+enum class ImageLayout { Linear, Tiled };
+
+inline int bytesPerPixel(PixelFormat f)
+{
+    static const int bytes[] = { 3, 4, 4, 8 };
+    return bytes[(int)f];
+}
+
+inline int channelCount(PixelFormat f)
+{
+    static const int channels[] = { 3, 4, 1, 4 };
+    return channels[(int)f];
+}
+
+inline const char* formatName(PixelFormat f)
+{
+    static const char* names[] = { "RGB8", "RGBA8", "R32F", "RGBA16F" };
+    return names[(int)f];
+}
+
+class Image;
+
+// a rectangle of an Image, holds no pixels of its own. coordinates are relative to the rectangle
+class ImageView {
+
+public:
+    Image* image = nullptr;
+    int x = 0, y = 0, width = 0, height = 0;
+
+    ImageView() {}
+    ImageView(Image* i, int rx, int ry, int w, int h) : image(i), x(rx), y(ry), width(w), height(h) {}
+
+    explicit operator bool() const { return image && width > 0 && height > 0; }
+
+    inline uint8_t* pixel(int px, int py) const;
+    inline uint8_t* row(int py) const; // Linear images only
+    inline size_t pitch() const;
+    inline PixelFormat format() const;
+
+    // clipped to this view
+    ImageView sub(int sx, int sy, int w, int h) const
+    {
+        int x0 = std::max(sx, 0), y0 = std::max(sy, 0);
+        int x1 = std::min(sx + w, width), y1 = std::min(sy + h, height);
+        return ImageView(image, x + x0, y + y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0));
+    }
+
+    // one pixel as RGBA floats, 8 bit formats map to 0..1, missing channels read as 0 (alpha 1)
+    glm::vec4 load(int px, int py) const
+    {
+        const uint8_t* p = pixel(px, py);
+
+        switch (format())
+        {
+        case PixelFormat::RGB8: return glm::vec4(p[0], p[1], p[2], 255.0f) / 255.0f;
+        case PixelFormat::RGBA8: return glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+        case PixelFormat::R32F:
+        {
+            float r;
+            memcpy(&r, p, 4);
+            return glm::vec4(r, 0.0f, 0.0f, 1.0f);
+        }
+        case PixelFormat::RGBA16F:
+        {
+            glm::detail::hdata h[4];
+            memcpy(h, p, 8);
+            return glm::vec4(glm::detail::toFloat32(h[0]), glm::detail::toFloat32(h[1]), glm::detail::toFloat32(h[2]),
+                glm::detail::toFloat32(h[3]));
+        }
+        }
+        return glm::vec4(0.0f);
+    }
+
+    void store(int px, int py, const glm::vec4& c) const
+    {
+        uint8_t* p = pixel(px, py);
+
+        switch (format())
+        {
+        case PixelFormat::RGB8:
+        case PixelFormat::RGBA8:
+            for (int i = 0; i < bytesPerPixel(format()); i++)
+                p[i] = (uint8_t)(glm::clamp(c[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+            break;
+        case PixelFormat::R32F:
+            memcpy(p, &c.r, 4);
+            break;
+        case PixelFormat::RGBA16F:
+        {
+            glm::detail::hdata h[4] = { glm::detail::toFloat16(c.r), glm::detail::toFloat16(c.g), glm::detail::toFloat16(c.b),
+                glm::detail::toFloat16(c.a) };
+            memcpy(p, h, 8);
+            break;
+        }
+        }
+    }
+
+    void fill(const glm::vec4& c) const
+    {
+        if (!*this)
+            return;
+
+        // encode once, then copy the bytes around
+        store(0, 0, c);
+        std::vector<uint8_t> texel(pixel(0, 0), pixel(0, 0) + bytesPerPixel(format()));
+
+        for (int py = 0; py < height; py++)
+            for (int px = 0; px < width; px++)
+                memcpy(pixel(px, py), texel.data(), texel.size());
+    }
+
+    // same size views, any formats and layouts (converted through load/store unless they match)
+    void copyFrom(const ImageView& src) const
+    {
+        int w = std::min(width, src.width), h = std::min(height, src.height);
+        size_t bytes = bytesPerPixel(format());
+
+        for (int py = 0; py < h; py++)
+            for (int px = 0; px < w; px++)
+            {
+                if (src.format() == format())
+                    memcpy(pixel(px, py), src.pixel(px, py), bytes);
+                else
+                    store(px, py, src.load(px, py));
+            }
+    }
+};
+
+class Image {
+
+    std::vector<uint8_t> storage; // over-allocated so the first row can be aligned
+    uint8_t* base = nullptr;
+    int w = 0, h = 0;
+    PixelFormat fmt = PixelFormat::RGBA8;
+    ImageLayout lay = ImageLayout::Linear;
+    size_t rowPitch = 0; // bytes from one row (Linear) or one row of tiles (Tiled) to the next
+    int tilesX = 0;
+
+public:
+    static const size_t ALIGNMENT = 64; // a cache line
+    static const int TILE = 8;          // Tiled layout
+
+    Image() {}
+    Image(int width, int height, PixelFormat format = PixelFormat::RGBA8, ImageLayout layout = ImageLayout::Linear)
+    {
+        resize(width, height, format, layout);
+    }
+
+    // moving keeps the pixels where they are, copies have to be asked for (copyFrom)
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+    Image(Image&&) = default;
+    Image& operator=(Image&&) = default;
+
+    // reallocates, the contents are cleared to 0
+    void resize(int width, int height, PixelFormat format, ImageLayout layout = ImageLayout::Linear)
+    {
+        w = std::max(width, 0);
+        h = std::max(height, 0);
+        fmt = format;
+        lay = layout;
+
+        size_t bpp = bytesPerPixel(fmt);
+        size_t bytes;
+
+        if (lay == ImageLayout::Linear)
+        {
+            // a multiple of the alignment that is also a whole number of pixels (192 bytes for RGB8)
+            size_t unit = ALIGNMENT;
+            while (unit % bpp)
+                unit += ALIGNMENT;
+
+            rowPitch = (w * bpp + unit - 1) / unit * unit;
+            tilesX = 0;
+            bytes = rowPitch * h;
+        }
+        else
+        {
+            tilesX = (w + TILE - 1) / TILE;
+            rowPitch = (size_t)tilesX * TILE * TILE * bpp;
+            bytes = rowPitch * ((h + TILE - 1) / TILE);
+        }
+
+        storage.assign(bytes + ALIGNMENT, 0);
+        base = storage.data() + (ALIGNMENT - (uintptr_t)storage.data() % ALIGNMENT) % ALIGNMENT;
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    PixelFormat format() const { return fmt; }
+    ImageLayout layout() const { return lay; }
+    int channels() const { return channelCount(fmt); }
+    int pixelBytes() const { return bytesPerPixel(fmt); }
+    size_t pitch() const { return rowPitch; }
+    bool linear() const { return lay == ImageLayout::Linear; }
+    bool empty() const { return !w || !h; }
+
+    uint8_t* data() { return base; }
+    const uint8_t* data() const { return base; }
+    size_t sizeBytes() const { return storage.empty() ? 0 : storage.size() - ALIGNMENT; }
+
+    uint8_t* pixel(int x, int y) { return base + offset(x, y); }
+    const uint8_t* pixel(int x, int y) const { return base + offset(x, y); }
+
+    uint8_t* row(int y) { return base + y * rowPitch; }
+    const uint8_t* row(int y) const { return base + y * rowPitch; }
+
+    ImageView view() { return ImageView(this, 0, 0, w, h); }
+    ImageView view(int x, int y, int width, int height) { return view().sub(x, y, width, height); }
+
+    size_t offset(int x, int y) const
+    {
+        if (lay == ImageLayout::Linear)
+            return y * rowPitch + (size_t)x * bytesPerPixel(fmt);
+
+        // interleave the low 3 bits of x and y
+        static const uint8_t spread[TILE] = { 0, 1, 4, 5, 16, 17, 20, 21 };
+
+        size_t tile = (size_t)(y / TILE) * tilesX + x / TILE;
+        size_t inside = spread[x % TILE] | (spread[y % TILE] << 1);
+        return (tile * TILE * TILE + inside) * bytesPerPixel(fmt);
+    }
+};
+
+inline uint8_t* ImageView::pixel(int px, int py) const { return image->pixel(x + px, y + py); }
+inline uint8_t* ImageView::row(int py) const { return image->pixel(x, y + py); }
+inline size_t ImageView::pitch() const { return image->pitch(); }
+inline PixelFormat ImageView::format() const { return image->format(); }
@@ -0,0 +1,203 @@
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma once
+// reading and decoding image files (stb_image) from any number of threads at once
+//
+//   ImageLoadOptions options;
+//   options.flipVertically = true;
+//   DecodedImage image = loadImageFile("data/brick1.jpg", options);
+//   if (!image) std::cout << imageLoadErrorName(image.error) << ": " << image.reason << std::endl;
+//
+// stb_image keeps its load settings (flip, unpremultiply, iPhone PNG conversion) in process wide globals, so two
+// threads decoding with different settings would race on them. nothing here ever sets those globals: every option
+// is applied per call after the decode, and the result carries its own error instead of leaving it behind in
+// stbi_failure_reason() (which is thread local as long as stb is built with thread locals, see below). the same goes
+// for stbi_jpeg_simd_limit() and stbi_png_simd_limit(): only --bench-decode calls them, before any job system exists
+#ifdef STBI_NO_THREAD_LOCALS
+#error "image_file.h reads stbi_failure_reason() right after each decode, it has to be thread local"
+#endif
+
+struct ImageLoadOptions {
+    int channels = 0;            // 1..4 to convert to that many channels, 0 keeps what the file has
+    bool flipVertically = false; // the last row first, the way GL texture coordinates expect it
+    bool convertIphonePng = false; // Xcode's "CgBI" PNGs store BGR(A), swap them back to RGB(A) (3 and 4 channel output)
+    bool unpremultiply = false;  // those PNGs also premultiply alpha, divide it back out (with convertIphonePng)
+};
+
+enum class ImageLoadError { None, ReadFailed, UnknownFormat, Unsupported, TooLarge, OutOfMemory, Corrupt };
+
+inline const char* imageLoadErrorName(ImageLoadError e)
+{
+    static const char* names[] = { "None", "ReadFailed", "UnknownFormat", "Unsupported", "TooLarge", "OutOfMemory", "Corrupt" };
+    return names[(int)e];
+}
+
+// pixels straight from stb (8 bits per channel, rows top to bottom unless flipped), freed with the object
+class DecodedImage {
+
+    struct Free {
+        void operator()(stbi_uc* p) const { stbi_image_free(p); }
+    };
+
+public:
+    std::unique_ptr<stbi_uc, Free> pixels;
+    int width = 0, height = 0;
+    int channels = 0;     // in pixels
+    int fileChannels = 0; // in the file
+    ImageLoadError error = ImageLoadError::None;
+    std::string reason; // stb's own words for the error, "" on success
+
+    explicit operator bool() const { return pixels != nullptr; }
+
+    size_t rowBytes() const { return (size_t)width * channels; }
+    size_t sizeBytes() const { return rowBytes() * height; }
+    const stbi_uc* row(int y) const { return pixels.get() + y * rowBytes(); }
+};
+
+// the whole file into bytes, false if it can't be opened or is empty
+inline bool readFileBytes(const std::string& path, std::string& bytes)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    std::streamsize size = file.tellg();
+    if (size <= 0)
+        return false;
+
+    bytes.resize((size_t)size);
+    file.seekg(0);
+    return (bool)file.read(&bytes[0], size);
+}
+
+namespace imagefile {
+
+    inline ImageLoadError classify(const char* reason)
+    {
+        // stb's short error strings (STBI_FAILURE_USERMSG is not defined)
+        static const struct { const char* prefix; ImageLoadError error; } known[] = {
+            { "can't fopen", ImageLoadError::ReadFailed },
+            { "unknown image type", ImageLoadError::UnknownFormat },
+            { "unsupported", ImageLoadError::Unsupported },
+            { "only 8-bit", ImageLoadError::Unsupported },
+            { "1/2/4/8/16-bit only", ImageLoadError::Unsupported },
+            { "max value > 255", ImageLoadError::Unsupported },
+            { "too large", ImageLoadError::TooLarge },
+            { "outofmem", ImageLoadError::OutOfMemory },
+        };
+
+        if (!reason)
+            return ImageLoadError::Corrupt;
+
+        for (const auto& k : known)
+            if (strncmp(reason, k.prefix, strlen(k.prefix)) == 0)
+                return k.error;
+
+        return ImageLoadError::Corrupt;
+    }
+
+    // an Xcode PNG has a CgBI chunk ahead of IHDR
+    inline bool isIphonePng(const uint8_t* bytes, size_t size)
+    {
+        static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        return size >= 16 && memcmp(bytes, signature, 8) == 0 && memcmp(bytes + 12, "CgBI", 4) == 0;
+    }
+
+    // what stb_image's de_iphone step does, without its globals
+    inline void deIphone(DecodedImage& image, bool unpremultiply)
+    {
+        stbi_uc* p = image.pixels.get();
+        size_t count = (size_t)image.width * image.height;
+
+        for (size_t i = 0; i < count; i++, p += image.channels)
+        {
+            stbi_uc b = p[0];
+
+            if (image.channels == 4 && unpremultiply && p[3])
+            {
+                int a = p[3], half = a / 2;
+                p[0] = (stbi_uc)std::min((p[2] * 255 + half) / a, 255);
+                p[1] = (stbi_uc)std::min((p[1] * 255 + half) / a, 255);
+                p[2] = (stbi_uc)std::min((b * 255 + half) / a, 255);
+            }
+            else
+            {
+                p[0] = p[2];
+                p[2] = b;
+            }
+        }
+    }
+
+    inline void flipRows(DecodedImage& image)
+    {
+        size_t bytes = image.rowBytes();
+        std::vector<stbi_uc> temp(bytes);
+        stbi_uc* pixels = image.pixels.get();
+
+        for (int top = 0, bottom = image.height - 1; top < bottom; top++, bottom--)
+        {
+            memcpy(temp.data(), pixels + top * bytes, bytes);
+            memcpy(pixels + top * bytes, pixels + bottom * bytes, bytes);
+            memcpy(pixels + bottom * bytes, temp.data(), bytes);
+        }
+    }
+}
+
+// any thread, any number of calls at the same time
+inline DecodedImage decodeImage(const void* bytes, size_t size, const ImageLoadOptions& options = ImageLoadOptions())
+{
+    DecodedImage image;
+
+    if (size > (size_t)INT32_MAX)
+    {
+        image.error = ImageLoadError::TooLarge;
+        image.reason = "file too large";
+        return image;
+    }
+
+    int desired = std::min(std::max(options.channels, 0), 4);
+
+    image.pixels.reset(stbi_load_from_memory((const stbi_uc*)bytes, (int)size, &image.width, &image.height,
+        &image.fileChannels, desired));
+
+    if (!image.pixels)
+    {
+        const char* reason = stbi_failure_reason(); // this thread's
+        image.error = imagefile::classify(reason);
+        image.reason = reason ? reason : "decode failed";
+        image.width = image.height = image.fileChannels = 0;
+        return image;
+    }
+
+    image.channels = desired ? desired : image.fileChannels;
+
+    if (options.convertIphonePng && image.channels >= 3 && imagefile::isIphonePng((const uint8_t*)bytes, size))
+        imagefile::deIphone(image, options.unpremultiply);
+
+    if (options.flipVertically)
+        imagefile::flipRows(image);
+
+    return image;
+}
+
+inline DecodedImage loadImageFile(const std::string& path, const ImageLoadOptions& options = ImageLoadOptions())
+{
+    std::string bytes;
+    if (!readFileBytes(path, bytes))
+    {
+        DecodedImage image;
+        image.error = ImageLoadError::ReadFailed;
+        image.reason = "can't read file";
+        return image;
+    }
+
+    return decodeImage(bytes.data(), bytes.size(), options);
+}
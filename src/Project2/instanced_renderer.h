@@ -0,0 +1,158 @@
+#include "renderer.h"
+#include "ring_buffer.h"
+
+#include <vector>
+
+#pragma once
+// draws many copies of one mesh with a single glDrawElementsInstanced call
+// each copy gets its own model matrix from a per instance vertex buffer (locations 1-4, see the INSTANCED variant of data/vertex.lgsl)
+// the renderer's own modelMatrix is applied on top of that, so the whole batch can still be moved around as one object
+class InstancedRenderer : public renderer {
+
+protected:
+    unsigned int instanceVBO = 0;
+    unsigned int instanceCount = 0;
+    unsigned int instanceCapacity = 0;
+
+    RingBuffer::Allocation streamed; // this frame's instances when they are streamed through a RingBuffer
+
+public: InstancedRenderer(Shader* shader, const float* vertices, unsigned int vertexFloatCount, const unsigned int* indices, unsigned int indices_count)
+{
+    modelMatrix = glm::mat4(1.0f);
+
+    myShader = shader;
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &instanceVBO);
+
+    glBindVertexArray(VAO);
+
+    // the shared mesh, exactly like a QuadRenderer
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexFloatCount * sizeof(float), vertices, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // per instance model matrices
+    setInstanceAttributes(instanceVBO, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_count * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+
+    indexCount = indices_count;
+
+    glBindVertexArray(0);
+
+    meshVertices.assign(vertices, vertices + vertexFloatCount);
+}
+
+public: ~InstancedRenderer()
+{
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+public: void setInstances(const std::vector<glm::mat4>& matrices)
+{
+    instanceCount = (unsigned int)matrices.size();
+
+    // back to the instance VBO in case the last frames were streamed
+    if (streamed)
+    {
+        glBindVertexArray(VAO);
+        setInstanceAttributes(instanceVBO, 0);
+        glBindVertexArray(0);
+
+        streamed = RingBuffer::Allocation();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+    // only reallocate storage when the batch grows, otherwise just overwrite the contents
+    if (instanceCount > instanceCapacity)
+    {
+        instanceCapacity = instanceCount;
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), matrices.data(), GL_DYNAMIC_DRAW);
+    }
+    else if (instanceCount > 0)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instanceCount * sizeof(glm::mat4), matrices.data());
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // the batch's bounds cover every instance, so culling treats it as one object
+    computeMeshBounds();
+    AABB single = meshBounds;
+
+    meshBounds = AABB();
+    for (const glm::mat4& m : matrices)
+        meshBounds.grow(single.transformed(m));
+
+    localTransform(); // bounds changed, flag the transform so the BoundsTree refits this object
+}
+
+public: unsigned int getInstanceCount() const { return instanceCount; }
+public: bool isStreaming() const { return (bool)streamed; }
+
+    // per frame instance data written straight into a RingBuffer, call every frame between the ring's beginFrame() and endFrame()
+    // returns where to write count matrices, nullptr if the ring is full this frame (it grows for the next one, the old instances stay)
+    // bounds stay whatever the last setInstances() computed, so keep animated instances close to those
+public: glm::mat4* mapInstances(RingBuffer& ring, unsigned int count)
+{
+    RingBuffer::Allocation a = ring.allocate(count * sizeof(glm::mat4), sizeof(glm::mat4));
+
+    if (!a)
+        return nullptr;
+
+    streamed = a;
+    instanceCount = count;
+
+    return (glm::mat4*)a.ptr;
+}
+
+public: void unmapInstances(RingBuffer& ring)
+{
+    if (!streamed)
+        return;
+
+    ring.flush(streamed);
+
+    glBindVertexArray(VAO);
+    setInstanceAttributes(streamed.buffer, streamed.offset);
+    glBindVertexArray(0);
+}
+
+    // a mat4 attribute takes four vec4 slots, read from buffer starting at offset
+protected: void setInstanceAttributes(unsigned int buffer, size_t offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(1 + i);
+        glVertexAttribDivisor(1 + i, 1); // advance once per instance instead of once per vertex
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+    public:  void draw(const glm::mat4& vMat, const glm::mat4& pMat) override
+    {
+        if (instanceCount == 0)
+            return;
+
+        glUniformMatrix4fv(myShader->uniformLocation(Shader::UNIFORM_M), 1, GL_FALSE, glm::value_ptr(getModelMatrix()));
+
+        setCameraUniforms(myShader, vMat, pMat);
+
+        // one call for the whole batch
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+    }
+};
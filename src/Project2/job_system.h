@@ -0,0 +1,200 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma once
+// small work stealing thread pool
+//
+// every worker owns a deque of jobs, it pops its own work from the back and, when that runs dry,
+// steals from the front of the other workers' deques. threads that wait on a parallelFor help out
+// by running jobs themselves, so nested or GL thread calls never just sit and block
+class JobSystem {
+
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<int> pending{ 0 };
+    std::atomic<unsigned int> nextQueue{ 0 };
+    bool quitting = false;
+
+    static inline thread_local int workerIndex = -1; // -1 for threads that don't belong to the pool
+
+public:
+    // one worker per core but the caller's (hardware_concurrency() is 0 when it doesn't know, that gets one worker)
+    explicit JobSystem(unsigned int threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1)
+    {
+        for (unsigned int i = 0; i < threadCount; i++)
+            queues.push_back(std::make_unique<WorkQueue>());
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            quitting = true;
+        }
+        wake.notify_all();
+
+        for (std::thread& t : workers)
+            t.join();
+    }
+
+    // the pool shared by the whole program
+    static JobSystem& instance()
+    {
+        static JobSystem pool;
+        return pool;
+    }
+
+    unsigned int threadCount() const { return (unsigned int)workers.size(); }
+
+    void submit(std::function<void()> job)
+    {
+        // workers push onto their own queue (good locality), everyone else spreads jobs round robin
+        unsigned int q = workerIndex >= 0 ? (unsigned int)workerIndex : nextQueue++ % queues.size();
+
+        {
+            std::lock_guard<std::mutex> guard(queues[q]->lock);
+            queues[q]->jobs.push_back(std::move(job));
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // run one queued job on the calling thread, returns false if there was nothing to do
+    bool runPendingJob()
+    {
+        std::function<void()> job;
+
+        if (!takeJob(workerIndex, job))
+            return false;
+
+        job();
+        return true;
+    }
+
+    // calls fn(begin, end) on chunks of at most grain items, spread over the pool
+    // the calling thread works on chunks too and returns once all of them are done
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+    {
+        if (count == 0)
+            return;
+
+        grain = std::max<size_t>(grain, 1);
+
+        if (count <= grain || workers.empty())
+        {
+            fn(0, count);
+            return;
+        }
+
+        std::atomic<size_t> remaining{ (count + grain - 1) / grain };
+
+        for (size_t begin = grain; begin < count; begin += grain)
+        {
+            size_t end = std::min(begin + grain, count);
+
+            submit([&fn, &remaining, begin, end] {
+                fn(begin, end);
+                remaining--;
+            });
+        }
+
+        fn(0, std::min(grain, count));
+        remaining--;
+
+        while (remaining > 0)
+        {
+            if (!runPendingJob())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    bool takeJob(int own, std::function<void()>& job)
+    {
+        // own queue first, newest job (still warm in cache)
+        if (own >= 0)
+        {
+            WorkQueue& q = *queues[own];
+            std::lock_guard<std::mutex> guard(q.lock);
+
+            if (!q.jobs.empty())
+            {
+                job = std::move(q.jobs.back());
+                q.jobs.pop_back();
+                pending--;
+                return true;
+            }
+        }
+
+        // then steal the oldest job from someone else
+        size_t n = queues.size();
+        size_t start = own >= 0 ? (size_t)own + 1 : 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t victim = (start + i) % n;
+            if ((int)victim == own)
+                continue;
+
+            WorkQueue& q = *queues[victim];
+            std::lock_guard<std::mutex> guard(q.lock);
+
+            if (!q.jobs.empty())
+            {
+                job = std::move(q.jobs.front());
+                q.jobs.pop_front();
+                pending--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void workerLoop(int index)
+    {
+        workerIndex = index;
+        G4G_TRACE_THREAD_NAME("Job worker " + std::to_string(index));
+
+        while (true)
+        {
+            std::function<void()> job;
+
+            if (takeJob(index, job))
+            {
+                job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return quitting || pending > 0; });
+
+            if (quitting && pending == 0)
+                return;
+        }
+    }
+};
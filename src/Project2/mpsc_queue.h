@@ -0,0 +1,61 @@
+#include <atomic>
+#include <utility>
+
+#pragma once
+// unbounded lock-free queue, any number of threads push, one thread pops (Vyukov's intrusive MPSC list)
+//
+// push is one atomic exchange plus a store, so producers never wait on each other or on the consumer.
+// a push that is halfway done (exchanged but not linked yet) simply isn't visible to pop until it completes,
+// pop then reports empty for that moment and the item shows up on a later call
+template<class T>
+class MpscQueue {
+
+    struct Node {
+        std::atomic<Node*> next{ nullptr };
+        T value;
+    };
+
+    std::atomic<Node*> head; // producers
+    Node* tail;              // consumer, always points at the node before the next item (a stub to begin with)
+
+public:
+    MpscQueue()
+    {
+        tail = new Node();
+        head.store(tail, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue()
+    {
+        T discard;
+        while (pop(discard))
+            ;
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // any thread
+    void push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // the consumer thread only, false if there is nothing (visible) yet
+    bool pop(T& value)
+    {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        value = std::move(next->value);
+        delete tail;
+        tail = next; // next becomes the new stub
+        return true;
+    }
+};
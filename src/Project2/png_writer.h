@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#pragma once
+// minimal PNG encoder for frame dumps, no compression library needed
+// the image data goes into "stored" (uncompressed) deflate blocks, so files are big but valid everywhere
+namespace png {
+
+inline uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0)
+{
+    static uint32_t table[256] = {};
+
+    if (!table[1])
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void putBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back((uint8_t)(v >> 24));
+    out.push_back((uint8_t)(v >> 16));
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+inline void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+    putBE32(out, (uint32_t)data.size());
+
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+
+    putBE32(out, crc32(out.data() + start, out.size() - start));
+}
+
+// pixels are tightly packed rows, top row first, channels = 3 (RGB) or 4 (RGBA)
+inline bool write(const std::string& path, int width, int height, int channels, const uint8_t* pixels)
+{
+    if (channels != 3 && channels != 4)
+        return false;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    std::vector<uint8_t> out(signature, signature + 8);
+
+    std::vector<uint8_t> header;
+    putBE32(header, width);
+    putBE32(header, height);
+    header.push_back(8);                       // bit depth
+    header.push_back(channels == 4 ? 6 : 2);   // color type RGBA / RGB
+    header.push_back(0);                       // compression
+    header.push_back(0);                       // filter
+    header.push_back(0);                       // interlace
+    putChunk(out, "IHDR", header);
+
+    // raw scanlines, each prefixed with filter type 0 (none)
+    size_t rowBytes = (size_t)width * channels;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+
+    for (int y = 0; y < height; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + y * rowBytes, pixels + (y + 1) * rowBytes);
+    }
+
+    // zlib stream made of stored blocks (at most 65535 bytes each), followed by the adler32 of the raw data
+    std::vector<uint8_t> z = { 0x78, 0x01 };
+
+    for (size_t pos = 0; pos < raw.size() || raw.empty(); )
+    {
+        size_t len = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + len == raw.size();
+
+        z.push_back(last ? 1 : 0);
+        z.push_back((uint8_t)len);
+        z.push_back((uint8_t)(len >> 8));
+        z.push_back((uint8_t)~len);
+        z.push_back((uint8_t)(~len >> 8));
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+
+        pos += len;
+        if (last)
+            break;
+    }
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t v : raw)
+    {
+        a = (a + v) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBE32(z, (b << 16) | a);
+
+    putChunk(out, "IDAT", z);
+    putChunk(out, "IEND", {});
+
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)out.data(), out.size());
+    return (bool)file;
+}
+
+}
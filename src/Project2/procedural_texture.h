@@ -0,0 +1,320 @@
+#include "job_system.h"
+#include "trace.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define G4G_PROCTEX_X86 1 // SSE2 is always there, AVX2 is checked at runtime
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#pragma once
+// procedural textures (checker, gradient, value noise, Perlin noise, Voronoi) for any size and channel count
+//
+//   proctex::Params p;
+//   p.pattern = proctex::Pattern::Perlin;
+//   p.scale = 64.0f;
+//   proctex::generate(pixels, 3840, 2160, 4, 3840 * 4, p);
+//
+// the patterns are computed as a 0..1 value per pixel, 8 (AVX2), 4 (SSE2) or 1 (anything else) pixels at a time, then
+// mapped through a colorA -> colorB lookup table per channel. the instruction set is picked once at runtime, so the
+// same binary runs on machines without AVX2. rows are spread over the job system.
+// Perlin noise is glm::perlin(vec2) (gtc/noise.hpp) step for step, the scalar path gives the same values
+namespace proctex {
+
+enum class Pattern { Checker, Gradient, ValueNoise, Perlin, Voronoi };
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+struct Params {
+    Pattern pattern = Pattern::Checker;
+    float scale = 16.0f;                  // checker square / noise cell size in pixels
+    glm::vec4 colorA = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); // value 0
+    glm::vec4 colorB = glm::vec4(1.0f);                    // value 1
+    int octaves = 4;                      // fBm octaves for the noises
+    float offsetX = 0.0f, offsetY = 0.0f; // pans the noises, in cells
+    float jitter = 1.0f;                  // Voronoi feature point spread, 0 is a regular grid
+    float angle = 0.0f;                   // gradient direction in degrees, 0 goes left to right
+};
+
+inline const char* patternName(Pattern p)
+{
+    static const char* names[] = { "Checker", "Gradient", "Value noise", "Perlin noise", "Voronoi" };
+    return names[(int)p];
+}
+
+inline const char* isaName(Isa isa)
+{
+    static const char* names[] = { "scalar", "SSE2", "AVX2" };
+    return names[(int)isa];
+}
+
+// what this CPU (and OS, for the AVX state) can run
+inline Isa detectIsa()
+{
+#if defined(G4G_PROCTEX_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+
+        if (osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6)
+            return Isa::AVX2;
+    }
+    return Isa::SSE2;
+#elif defined(G4G_PROCTEX_X86)
+    return __builtin_cpu_supports("avx2") ? Isa::AVX2 : Isa::SSE2;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+inline Isa bestIsa()
+{
+    static const Isa isa = detectIsa();
+    return isa;
+}
+
+// Params turned into what the kernels need per pixel
+struct Setup {
+    Pattern pattern;
+    float invScale;
+    float offsetX, offsetY;
+    float jitter;
+    int octaves;
+    float gradientX, gradientY, gradientOffset; // value = x * gradientX + y * gradientY + gradientOffset
+};
+
+inline Setup makeSetup(const Params& p, int width, int height)
+{
+    Setup s;
+    s.pattern = p.pattern;
+    s.invScale = 1.0f / std::max(p.scale, 1e-3f);
+    s.offsetX = p.offsetX;
+    s.offsetY = p.offsetY;
+    s.jitter = p.jitter;
+    s.octaves = std::max(p.octaves, 1);
+
+    // 0 at the first pixel center the direction reaches, 1 at the last one
+    float a = glm::radians(p.angle);
+    float dx = std::cos(a), dy = std::sin(a);
+    float x0 = 0.5f, x1 = width - 0.5f, y0 = 0.5f, y1 = height - 0.5f;
+    float lo = std::min(dx * x0, dx * x1) + std::min(dy * y0, dy * y1);
+    float hi = std::max(dx * x0, dx * x1) + std::max(dy * y0, dy * y1);
+    float range = std::max(hi - lo, 1e-6f);
+
+    s.gradientX = dx / range;
+    s.gradientY = dy / range;
+    s.gradientOffset = (0.5f * (dx + dy) - lo) / range;
+
+    return s;
+}
+
+// one lane, for CPUs without a kernel of their own
+// ------------------------------------------------------------------------
+namespace scalar {
+
+static const int LANES = 1;
+typedef float V;
+
+inline V vfloor(V a) { return std::floor(a); }
+inline V vabs(V a) { return std::fabs(a); }
+inline V vmin(V a, V b) { return a < b ? a : b; }
+inline V vmax(V a, V b) { return a > b ? a : b; }
+inline V viota() { return 0.0f; }
+inline void storeLevels(uint8_t* out, V a) { out[0] = (uint8_t)(a * 255.0f + 0.5f); }
+
+#include "procedural_texture_kernels.h"
+
+}
+
+#if defined(G4G_PROCTEX_X86)
+// 4 lanes, baseline on x86-64
+// ------------------------------------------------------------------------
+namespace sse2 {
+
+static const int LANES = 4;
+
+struct V {
+    __m128 v;
+    V() {}
+    V(float a) : v(_mm_set1_ps(a)) {}
+    V(__m128 a) : v(a) {}
+};
+
+inline V operator+(V a, V b) { return _mm_add_ps(a.v, b.v); }
+inline V operator-(V a, V b) { return _mm_sub_ps(a.v, b.v); }
+inline V operator*(V a, V b) { return _mm_mul_ps(a.v, b.v); }
+inline V operator/(V a, V b) { return _mm_div_ps(a.v, b.v); }
+
+// no roundps before SSE4.1: truncate, then step down where that rounded up (negative non-integers)
+inline V vfloor(V a)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+inline V vabs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline V vmin(V a, V b) { return _mm_min_ps(a.v, b.v); }
+inline V vmax(V a, V b) { return _mm_max_ps(a.v, b.v); }
+inline V viota() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+
+inline void storeLevels(uint8_t* out, V a)
+{
+    __m128i i = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(a.v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    int32_t packed = _mm_cvtsi128_si32(i);
+    memcpy(out, &packed, 4);
+}
+
+#include "procedural_texture_kernels.h"
+
+}
+
+// 8 lanes, only called after detectIsa said so
+// ------------------------------------------------------------------------
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2 {
+
+static const int LANES = 8;
+
+struct V {
+    __m256 v;
+    V() {}
+    V(float a) : v(_mm256_set1_ps(a)) {}
+    V(__m256 a) : v(a) {}
+};
+
+inline V operator+(V a, V b) { return _mm256_add_ps(a.v, b.v); }
+inline V operator-(V a, V b) { return _mm256_sub_ps(a.v, b.v); }
+inline V operator*(V a, V b) { return _mm256_mul_ps(a.v, b.v); }
+inline V operator/(V a, V b) { return _mm256_div_ps(a.v, b.v); }
+
+inline V vfloor(V a) { return _mm256_floor_ps(a.v); }
+inline V vabs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline V vmin(V a, V b) { return _mm256_min_ps(a.v, b.v); }
+inline V vmax(V a, V b) { return _mm256_max_ps(a.v, b.v); }
+inline V viota() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+
+inline void storeLevels(uint8_t* out, V a)
+{
+    __m256i i = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(a.v, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+    __m128i lo = _mm256_castsi256_si128(i), hi = _mm256_extracti128_si256(i, 1);
+    __m128i w = _mm_packs_epi32(lo, hi);
+    w = _mm_packus_epi16(w, w);
+    _mm_storel_epi64((__m128i*)out, w);
+}
+
+#include "procedural_texture_kernels.h"
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif
+
+// ------------------------------------------------------------------------
+
+// widest lane count of any kernel, rows of levels are padded to a multiple of it
+static const int MAX_LANES = 8;
+
+inline void levelsRow(Isa isa, const Setup& s, int y, int width, uint8_t* levels)
+{
+#if defined(G4G_PROCTEX_X86)
+    if (isa == Isa::AVX2)
+        return avx2::row(s, y, width, levels);
+    if (isa == Isa::SSE2)
+        return sse2::row(s, y, width, levels);
+#endif
+    scalar::row(s, y, width, levels);
+}
+
+// fills a width x height image with channels bytes per pixel, rows stride bytes apart.
+// channels past the 4th get the pattern value as is. isa is clamped to what the CPU supports
+inline void generate(uint8_t* pixels, int width, int height, int channels, size_t stride, const Params& params, Isa isa = bestIsa())
+{
+    G4G_TRACE_SCOPE("proctex::generate");
+
+    if (width <= 0 || height <= 0 || channels <= 0)
+        return;
+
+    isa = std::min(isa, bestIsa());
+
+    Setup setup = makeSetup(params, width, height);
+
+    // level -> byte, per channel
+    std::vector<uint8_t> luts((size_t)channels * 256);
+    for (int c = 0; c < channels; c++)
+        for (int l = 0; l < 256; l++)
+        {
+            float a = c < 4 ? params.colorA[c] : 0.0f, b = c < 4 ? params.colorB[c] : 1.0f;
+            float v = a + (b - a) * (l / 255.0f);
+            luts[c * 256 + l] = (uint8_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+
+    // RGBA: one 4 byte store per pixel
+    uint32_t rgba[256];
+    if (channels == 4)
+        for (int l = 0; l < 256; l++)
+        {
+            uint8_t texel[4] = { luts[l], luts[256 + l], luts[512 + l], luts[768 + l] };
+            memcpy(&rgba[l], texel, 4);
+        }
+
+    size_t paddedWidth = (width + MAX_LANES - 1) / MAX_LANES * MAX_LANES;
+
+    JobSystem::instance().parallelFor(height, 16, [&](size_t begin, size_t end) {
+        std::vector<uint8_t> levels(paddedWidth);
+
+        for (size_t y = begin; y < end; y++)
+        {
+            levelsRow(isa, setup, (int)y, width, levels.data());
+
+            uint8_t* out = pixels + y * stride;
+
+            if (channels == 1)
+            {
+                for (int x = 0; x < width; x++)
+                    out[x] = luts[levels[x]];
+                continue;
+            }
+
+            if (channels == 4)
+            {
+                for (int x = 0; x < width; x++)
+                    memcpy(out + x * 4, &rgba[levels[x]], 4);
+                continue;
+            }
+
+            for (int x = 0; x < width; x++, out += channels)
+                for (int c = 0; c < channels; c++)
+                    out[c] = luts[c * 256 + levels[x]];
+        }
+    });
+}
+
+}
@@ -0,0 +1,148 @@
+// pattern kernels, written once against a small vector type V (float lanes) and compiled once per instruction set
+//
+// no #pragma once on purpose: procedural_texture.h includes this file inside namespace scalar, sse2 and avx2, each
+// time after defining V (LANES floats with + - * / and a conversion from float), vfloor, vabs, vmin, vmax,
+// viota() (0, 1, 2, ... per lane) and storeLevels(uint8_t*, V) which writes LANES values of 0..1 as 0..255
+
+inline V vfract(V x) { return x - vfloor(x); }
+
+// glm::detail::mod289 / permute / taylorInvSqrt / fade, the same float operations in the same order
+inline V mod289(V x) { return x - vfloor(x * V(1.0f / 289.0f)) * V(289.0f); }
+inline V permute(V x) { return mod289(((x * V(34.0f)) + V(1.0f)) * x); }
+inline V taylorInvSqrt(V r) { return V(1.79284291400159f) - V(0.85373472095314f) * r; }
+inline V fade(V t) { return (t * t * t) * (t * (t * V(6.0f) - V(15.0f)) + V(10.0f)); }
+inline V mix(V x, V y, V a) { return x + a * (y - x); }
+inline V glmMod(V x, V y) { return x - y * vfloor(x / y); }
+
+// glm::perlin(vec2), one pixel per lane, result in about -1..1
+inline V perlin(V px, V py)
+{
+    V pix = vfloor(px), piy = vfloor(py);
+    V pfx = vfract(px), pfy = vfract(py);
+
+    V ix0 = glmMod(pix, V(289.0f)), iy0 = glmMod(piy, V(289.0f));
+    V ix1 = glmMod(pix + V(1.0f), V(289.0f)), iy1 = glmMod(piy + V(1.0f), V(289.0f));
+    V fx0 = pfx, fy0 = pfy;
+    V fx1 = pfx - V(1.0f), fy1 = pfy - V(1.0f);
+
+    // corner order 00, 10, 01, 11 as in glm
+    V ix[4] = { ix0, ix1, ix0, ix1 };
+    V iy[4] = { iy0, iy0, iy1, iy1 };
+    V fx[4] = { fx0, fx1, fx0, fx1 };
+    V fy[4] = { fy0, fy0, fy1, fy1 };
+
+    V n[4];
+    for (int c = 0; c < 4; c++)
+    {
+        V i = permute(permute(ix[c]) + iy[c]);
+
+        V gx = V(2.0f) * vfract(i / V(41.0f)) - V(1.0f);
+        V gy = vabs(gx) - V(0.5f);
+        V tx = vfloor(gx + V(0.5f));
+        gx = gx - tx;
+
+        V norm = taylorInvSqrt(gx * gx + gy * gy);
+        gx = gx * norm;
+        gy = gy * norm;
+
+        n[c] = gx * fx[c] + gy * fy[c];
+    }
+
+    V fadeX = fade(pfx), fadeY = fade(pfy);
+    V nx0 = mix(n[0], n[1], fadeX); // n00 -> n10
+    V nx1 = mix(n[2], n[3], fadeX); // n01 -> n11
+    return V(2.3f) * mix(nx0, nx1, fadeY);
+}
+
+// lattice hash in 0..1, built from the same permutation polynomial
+inline V hash(V ix, V iy)
+{
+    return vfract(permute(permute(glmMod(ix, V(289.0f))) + glmMod(iy, V(289.0f))) * V(1.0f / 41.0f));
+}
+
+// smoothly interpolated random values on the integer lattice, result in 0..1
+inline V valueNoise(V px, V py)
+{
+    V ix = vfloor(px), iy = vfloor(py);
+    V fx = fade(px - ix), fy = fade(py - iy);
+
+    V a = hash(ix, iy), b = hash(ix + V(1.0f), iy);
+    V c = hash(ix, iy + V(1.0f)), d = hash(ix + V(1.0f), iy + V(1.0f));
+
+    return mix(mix(a, b, fx), mix(c, d, fx), fy);
+}
+
+// squared distance to the nearest of one jittered feature point per cell (Worley F1), result in 0..1
+inline V voronoi(V px, V py, V jitter)
+{
+    V ix = vfloor(px), iy = vfloor(py);
+    V fx = px - ix, fy = py - iy;
+    V best(8.0f);
+
+    for (int oy = -1; oy <= 1; oy++)
+        for (int ox = -1; ox <= 1; ox++)
+        {
+            V cx = ix + V((float)ox), cy = iy + V((float)oy);
+            V h = hash(cx, cy);
+            V hx = h, hy = vfract(h * V(17.0f) + V(0.31f));
+
+            V dx = V((float)ox) + V(0.5f) + (hx - V(0.5f)) * jitter - fx;
+            V dy = V((float)oy) + V(0.5f) + (hy - V(0.5f)) * jitter - fy;
+
+            best = vmin(best, dx * dx + dy * dy);
+        }
+
+    return vmin(best, V(1.0f));
+}
+
+inline V pattern(const Setup& p, V x, V y)
+{
+    switch (p.pattern)
+    {
+    case Pattern::Checker:
+    {
+        // 1 on even cells, like the original myTexture
+        V cells = vfloor(x * V(p.invScale)) + vfloor(y * V(p.invScale));
+        return V(1.0f) - V(2.0f) * vfract(cells * V(0.5f));
+    }
+    case Pattern::Gradient:
+    {
+        V u = x * V(p.gradientX) + y * V(p.gradientY) + V(p.gradientOffset);
+        return vmin(vmax(u, V(0.0f)), V(1.0f));
+    }
+    default:
+        break;
+    }
+
+    // noise patterns: sample position in cells, plus fBm octaves
+    V sx = (x + V(0.5f)) * V(p.invScale) + V(p.offsetX);
+    V sy = (y + V(0.5f)) * V(p.invScale) + V(p.offsetY);
+
+    if (p.pattern == Pattern::Voronoi)
+        return voronoi(sx, sy, V(p.jitter));
+
+    V sum(0.0f);
+    float amplitude = 1.0f, total = 0.0f;
+
+    for (int o = 0; o < p.octaves; o++)
+    {
+        V n = p.pattern == Pattern::Perlin ? perlin(sx, sy) * V(0.5f) + V(0.5f) : valueNoise(sx, sy);
+
+        sum = sum + n * V(amplitude);
+        total += amplitude;
+        amplitude *= 0.5f;
+        sx = sx * V(2.0f);
+        sy = sy * V(2.0f);
+    }
+
+    return vmin(vmax(sum * V(1.0f / total), V(0.0f)), V(1.0f));
+}
+
+// one row of 0..255 levels, levels must have room for width rounded up to LANES
+inline void row(const Setup& p, int y, int width, uint8_t* levels)
+{
+    V fy((float)y);
+
+    for (int x = 0; x < width; x += LANES)
+        storeLevels(levels + x, pattern(p, V((float)x) + viota(), fy));
+}
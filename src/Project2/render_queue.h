@@ -0,0 +1,152 @@
+#include "renderer.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#pragma once
+// collects the frame's renderers as draw packets, sorts them by GL state and submits them
+// so consecutive draws sharing a program, texture or VAO don't rebind it
+//
+// sort key layout (most significant first), 16 bits each:
+//   shader program | texture | VAO | view depth (front to back)
+struct DrawPacket {
+    uint64_t key;
+    renderer* r;
+};
+
+class RenderQueue {
+
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> scratch; // ping-pong buffer for the radix sort
+
+public:
+    struct Stats {
+        unsigned int draws = 0;
+        unsigned int programBinds = 0, programSkips = 0;
+        unsigned int vaoBinds = 0, vaoSkips = 0;
+        unsigned int textureBinds = 0, textureSkips = 0;
+
+        unsigned int skipped() const { return programSkips + vaoSkips + textureSkips; }
+    };
+
+    // depth range mapped onto the 16 depth bits of the key
+    float maxDepth = 1000.0f;
+
+    Stats stats;
+
+    void clear()
+    {
+        packets.clear();
+    }
+
+    void submit(renderer* r, const glm::mat4& vMat)
+    {
+        // distance in front of the camera of the object's origin
+        float depth = -(vMat * r->getModelMatrix()[3]).z;
+        float normalized = glm::clamp(depth / maxDepth, 0.0f, 1.0f);
+
+        uint64_t key = 0;
+        key |= (uint64_t)(r->getShader()->ID & 0xFFFF) << 48;
+        key |= (uint64_t)(r->getTexture() & 0xFFFF) << 32;
+        key |= (uint64_t)(r->getVAO() & 0xFFFF) << 16;
+        key |= (uint64_t)(normalized * 65535.0f);
+
+        packets.push_back({ key, r });
+    }
+
+    // LSD radix sort on the key, one byte per pass
+    // all eight histograms are built in a single sweep, and passes where every key has the same byte are skipped
+    void sort()
+    {
+        size_t n = packets.size();
+        if (n < 2)
+            return;
+
+        scratch.resize(n);
+
+        unsigned int counts[8][256] = {};
+
+        for (const DrawPacket& p : packets)
+            for (int b = 0; b < 8; b++)
+                counts[b][(p.key >> (b * 8)) & 0xFF]++;
+
+        DrawPacket* src = packets.data();
+        DrawPacket* dst = scratch.data();
+
+        for (int b = 0; b < 8; b++)
+        {
+            unsigned int* count = counts[b];
+
+            if (count[(src[0].key >> (b * 8)) & 0xFF] == n)
+                continue; // nothing to do for this byte
+
+            unsigned int offsets[256];
+            unsigned int sum = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                offsets[i] = sum;
+                sum += count[i];
+            }
+
+            for (size_t i = 0; i < n; i++)
+                dst[offsets[(src[i].key >> (b * 8)) & 0xFF]++] = src[i];
+
+            std::swap(src, dst);
+        }
+
+        if (src != packets.data())
+            packets.swap(scratch);
+    }
+
+    // issue the draws, only touching GL state that actually changes between packets
+    void execute(const glm::mat4& vMat, const glm::mat4& pMat)
+    {
+        stats = Stats();
+
+        // nothing is assumed about state left over from the previous frame (imGui changes all of it)
+        unsigned int currentProgram = ~0u, currentVAO = ~0u, currentTexture = ~0u;
+
+        for (const DrawPacket& p : packets)
+        {
+            renderer* r = p.r;
+            Shader* shader = r->getShader();
+
+            if (!shader->ready()) // first link still in flight
+                continue;
+
+            if (shader->ID != currentProgram)
+            {
+                shader->use();
+                currentProgram = shader->ID;
+                stats.programBinds++;
+            }
+            else
+                stats.programSkips++;
+
+            if (r->getTexture())
+            {
+                if (r->getTexture() != currentTexture)
+                {
+                    glBindTexture(GL_TEXTURE_2D, r->getTexture());
+                    currentTexture = r->getTexture();
+                    stats.textureBinds++;
+                }
+                else
+                    stats.textureSkips++;
+            }
+
+            if (r->getVAO() != currentVAO)
+            {
+                glBindVertexArray(r->getVAO());
+                currentVAO = r->getVAO();
+                stats.vaoBinds++;
+            }
+            else
+                stats.vaoSkips++;
+
+            r->draw(vMat, pMat);
+            stats.draws++;
+        }
+    }
+};
@@ -1,5 +1,10 @@
 
 #include "shader_s.h"
+#include "bounds.h"
+#include "transform_hierarchy.h"
+#include "trace.h"
+
+#include <vector>
 
 #pragma once
 class renderer {
@@ -12,44 +17,166 @@ protected:
 
     Shader* myShader;
 
+    unsigned int texture = 0; // optional GL_TEXTURE_2D bound to unit 0 while drawing (0 = none)
+
+    // CPU copy of the mesh (xyz positions and triangle indices), used by the StaticBatch
+    std::vector<float> meshVertices;
+    std::vector<unsigned int> meshIndices;
+
+    bool staticBatched = false; // drawn by a StaticBatch instead of on its own
+
+    // object space bounds of the mesh, objects without bounds are never culled
+    AABB meshBounds;
+
+    // bumped on every change of modelMatrix, lets the BoundsTree refit only the objects that moved
+    unsigned int transformVersion = 0;
+
+    // when attached to a TransformHierarchy node, the transform calls edit the node's local matrix
+    // and the world matrix comes from the hierarchy instead of modelMatrix
+    TransformHierarchy* hierarchy = nullptr;
+    int hierarchyNode = -1;
+
+    // mvp from the last draw, only recomputed when the object or the camera moved
+    glm::mat4 mvp;
+    glm::mat4 mvpViewProjection;
+    unsigned int mvpVersion = ~0u;
+
+public: virtual ~renderer() {}
+
+public: Shader* getShader() const { return myShader; }
+public: unsigned int getVAO() const { return VAO; }
+public: unsigned int getTexture() const { return texture; }
+public: const glm::mat4& getModelMatrix() const { return hierarchy ? hierarchy->world(hierarchyNode) : modelMatrix; }
+public: const std::vector<float>& getMeshVertices() const { return meshVertices; }
+public: const std::vector<unsigned int>& getMeshIndices() const { return meshIndices; }
+
+public: bool hasBounds() const { return !meshBounds.isEmpty(); }
+public: AABB worldBounds() const { return meshBounds.transformed(getModelMatrix()); }
+public: unsigned int getTransformVersion() const { return hierarchy ? hierarchy->version(hierarchyNode) : transformVersion; }
+
+public: void attachTransform(TransformHierarchy* h, int node)
+{
+    hierarchy = h;
+    hierarchyNode = node;
+
+    if (hierarchy)
+        hierarchy->setLocal(hierarchyNode, modelMatrix);
+}
+
+public: int getTransformNode() const { return hierarchy ? hierarchyNode : -1; }
+
+public: bool isStaticBatched() const { return staticBatched; }
+public: void setStaticBatched(bool batched) { staticBatched = batched; }
+
+public: void setTexture(unsigned int tex)
+{
+    texture = tex;
+}
+
 public: void setXForm(glm::mat4 mat)
 {
-    modelMatrix = mat;
+    localTransform() = mat;
 }
 
 public: void rotate(const float axis[], const float angle)
 {
-    modelMatrix = glm::rotate(modelMatrix, angle, glm::vec3(axis[0], axis[1], axis[2]));
+    glm::mat4& m = localTransform();
+    m = glm::rotate(m, angle, glm::vec3(axis[0], axis[1], axis[2]));
 }    
 
 public: void translate(const float trans[])
 {
-    modelMatrix = glm::translate(modelMatrix, glm::vec3(trans[0], trans[1], trans[2]));
+    glm::mat4& m = localTransform();
+    m = glm::translate(m, glm::vec3(trans[0], trans[1], trans[2]));
 }
 
 public: void scale(const float scale[])
 {
-    modelMatrix = glm::scale(modelMatrix, glm::vec3(scale[0], scale[1], scale[2]));
+    glm::mat4& m = localTransform();
+    m = glm::scale(m, glm::vec3(scale[0], scale[1], scale[2]));
 }
 
-    public:  void render(glm::mat4 vMat, glm::mat4 pMat, double deltaTime)
+    // the matrix the transform calls edit, marked as changed
+protected: glm::mat4& localTransform()
+{
+    if (hierarchy)
+        return hierarchy->editLocal(hierarchyNode);
+
+    transformVersion++;
+    return modelMatrix;
+}
+
+    // derive the object space bounds from the CPU copy of the mesh
+protected: void computeMeshBounds()
+{
+    meshBounds = AABB();
+
+    for (size_t i = 0; i + 2 < meshVertices.size(); i += 3)
+        meshBounds.grow(glm::vec3(meshVertices[i], meshVertices[i + 1], meshVertices[i + 2]));
+}
+
+    // refresh the cached mvp if the object or the camera moved since it was computed
+    // touches nothing but this object, so it can run on any thread (see the parallel pass in Main.cpp)
+public: void updateMVP(const glm::mat4& viewProjection)
+{
+    if (mvpVersion != getTransformVersion() || mvpViewProjection != viewProjection)
+    {
+        mvp = viewProjection * getModelMatrix();
+        mvpViewProjection = viewProjection;
+        mvpVersion = getTransformVersion();
+    }
+}
+
+    // view and perspective normally come from the per frame Camera block, only shaders that still declare them as plain uniforms get them here
+public: static void setCameraUniforms(Shader* shader, const glm::mat4& vMat, const glm::mat4& pMat)
+{
+    int vLocation = shader->uniformLocation(Shader::UNIFORM_V);
+    if (vLocation >= 0)
+        glUniformMatrix4fv(vLocation, 1, GL_FALSE, glm::value_ptr(vMat));
+
+    int pLocation = shader->uniformLocation(Shader::UNIFORM_P);
+    if (pLocation >= 0)
+        glUniformMatrix4fv(pLocation, 1, GL_FALSE, glm::value_ptr(pMat));
+}
+
+    public:  virtual void render(glm::mat4 vMat, glm::mat4 pMat, double deltaTime)
     { // here's where the "actual drawing" gets done
+        G4G_TRACE_SCOPE("renderer::render");
 
-        glm::mat4 mvp;
+        if (!myShader->ready()) // first link still in flight
+            return;
 
         myShader->use();
 
         //rotate(glm::value_ptr(glm::vec3(0.0f, 0.0f, 1.0f)), deltaTime); // easter egg!  rotate incrementally with delta time
 
-        mvp = pMat * vMat * modelMatrix;
+        if (texture)
+            glBindTexture(GL_TEXTURE_2D, texture);
 
-        glUniformMatrix4fv(glGetUniformLocation(myShader->ID, "m"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(myShader->ID, "v"), 1, GL_FALSE, glm::value_ptr(vMat));
-        glUniformMatrix4fv(glGetUniformLocation(myShader->ID, "p"), 1, GL_FALSE, glm::value_ptr(pMat));
+        glBindVertexArray(VAO);
 
-        glUniformMatrix4fv(glGetUniformLocation(myShader->ID, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+        draw(vMat, pMat);
+    }
 
-        glBindVertexArray(VAO);
+    // per object uniforms and the draw call itself, the program, texture and VAO are expected to be bound already
+    // (render() binds them unconditionally, the RenderQueue only binds them when they change)
+    public:  virtual void draw(const glm::mat4& vMat, const glm::mat4& pMat)
+    {
+        // locations come from the shader's cache, no per draw string lookups into the driver
+        // data/vertex.lgsl only takes the finished mvp, shaders that still multiply on the GPU get m instead
+        int mvpLocation = myShader->uniformLocation(Shader::UNIFORM_MVP);
+        if (mvpLocation >= 0)
+        {
+            updateMVP(pMat * vMat); // normally already done by the parallel pass before submission
+
+            glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
+        }
+
+        int mLocation = myShader->uniformLocation(Shader::UNIFORM_M);
+        if (mLocation >= 0)
+            glUniformMatrix4fv(mLocation, 1, GL_FALSE, glm::value_ptr(getModelMatrix()));
+
+        setCameraUniforms(myShader, vMat, pMat);
 
         glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
     }
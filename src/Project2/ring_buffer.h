@@ -0,0 +1,188 @@
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#pragma once
+// triple buffered streaming buffer for data that is rewritten every frame (per object matrices, debug lines, pixels...)
+//
+// the buffer is split into 3 regions, one per frame in flight. a region is only written again once the fence placed
+// at the end of the frame that used it has signaled, so the CPU never overwrites data the GPU is still reading and
+// the driver never has to orphan or reallocate storage.
+// with ARB_buffer_storage the buffer is mapped once (persistent + coherent) and allocations point straight into it.
+// without it (the 4.1 context on macOS) allocations are staged in CPU memory and flush() copies them over.
+//
+// per frame:  beginFrame(), allocate() + write + flush() as often as needed, draw, endFrame()
+class RingBuffer {
+
+public:
+    static const unsigned int REGION_COUNT = 3;
+
+    struct Allocation {
+        void* ptr = nullptr;   // where to write, nullptr if the frame's region is full
+        size_t offset = 0;     // offset into buffer, for glVertexAttribPointer / glBindBufferRange etc.
+        size_t size = 0;
+        unsigned int buffer = 0;
+
+        explicit operator bool() const { return ptr != nullptr; }
+    };
+
+private:
+    unsigned int buffer = 0;
+    size_t regionSize = 0;
+    size_t requestedSize = 0; // grow to this at the next beginFrame
+    bool persistent = false;
+
+    char* mapped = nullptr;      // persistent mapping of the whole buffer
+    std::vector<char> staging;   // fallback without buffer storage
+
+    GLsync fences[REGION_COUNT] = {};
+    unsigned int region = 0;
+    size_t head = 0;
+
+public:
+    unsigned int fenceWaits = 0; // frames where the CPU had to wait for the GPU to release a region
+
+    explicit RingBuffer(size_t bytesPerFrame)
+    {
+        persistent = GLAD_GL_ARB_buffer_storage != 0;
+        create(bytesPerFrame);
+    }
+
+    ~RingBuffer()
+    {
+        destroy();
+    }
+
+    unsigned int id() const { return buffer; }
+    size_t capacity() const { return regionSize; }
+    size_t used() const { return head; }
+    bool isPersistent() const { return persistent; }
+
+    void beginFrame()
+    {
+        if (requestedSize > regionSize)
+        {
+            // every region might still be in use, wait for all of them before throwing the buffer away
+            for (unsigned int i = 0; i < REGION_COUNT; i++)
+                waitFence(i);
+
+            destroy();
+            create(requestedSize);
+        }
+
+        region = (region + 1) % REGION_COUNT;
+        head = 0;
+
+        waitFence(region);
+    }
+
+    // alignment must be a power of two, returns an empty allocation (and grows the buffer next frame) if the region is full
+    Allocation allocate(size_t size, size_t alignment = 16)
+    {
+        Allocation a;
+
+        size_t start = (head + alignment - 1) & ~(alignment - 1);
+
+        if (start + size > regionSize)
+        {
+            requestedSize = std::max(requestedSize, (start + size) * 2);
+            return a;
+        }
+
+        head = start + size;
+
+        a.offset = region * regionSize + start;
+        a.size = size;
+        a.buffer = buffer;
+        a.ptr = (persistent ? mapped : staging.data()) + a.offset;
+        return a;
+    }
+
+    // make written data visible to GL (a no-op for the coherent persistent mapping)
+    void flush(const Allocation& a)
+    {
+        if (persistent || !a)
+            return;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, a.offset, a.size, a.ptr);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // after the frame's draws have been issued
+    void endFrame()
+    {
+        if (fences[region])
+            glDeleteSync(fences[region]);
+
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    void create(size_t size)
+    {
+        regionSize = size;
+        requestedSize = size;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, NULL, flags);
+            mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * REGION_COUNT, flags);
+        }
+        else
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, NULL, GL_STREAM_DRAW);
+            staging.resize(regionSize * REGION_COUNT);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void destroy()
+    {
+        for (unsigned int i = 0; i < REGION_COUNT; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+
+        if (mapped)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = nullptr;
+        }
+
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    void waitFence(unsigned int i)
+    {
+        if (!fences[i])
+            return;
+
+        // cheap check first, only count (and flush) when the GPU really is behind
+        GLenum status = glClientWaitSync(fences[i], 0, 0);
+
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            fenceWaits++;
+
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms steps
+        }
+
+        glDeleteSync(fences[i]);
+        fences[i] = 0;
+    }
+};
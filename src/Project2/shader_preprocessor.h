@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#pragma once
+// resolves #include "file" and injects #define permutations before GLSL ever sees the source
+//
+// includes are relative to the including file and expand in place. every file gets its own GLSL source string number
+// through #line, so a compile error at "1(12)" means line 12 of files[1]. defines are inserted right after #version
+// (which has to stay the first statement), "NAME" becomes "#define NAME 1" and "NAME=value" becomes "#define NAME value"
+class ShaderPreprocessor {
+
+public:
+    static const int MAX_INCLUDE_DEPTH = 16;
+
+    std::vector<std::string> files; // every file that went into the output, files[0] is the main one
+    std::string error;
+
+    // source is the text of path (possibly edited and not saved yet), false with error set if an include failed
+    bool run(const std::string& path, const std::string& source, const std::vector<std::string>& defines, std::string& out)
+    {
+        files.assign(1, path);
+        error.clear();
+        out.clear();
+        out.reserve(source.size() * 2);
+
+        std::vector<std::string> stack = { normalized(path) };
+        return expand(path, source, 0, &defines, stack, out);
+    }
+
+    // the whole file with one read straight into the string, sized up front
+    static bool readFile(const std::string& path, std::string& text)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        std::streamsize size = file.tellg();
+        if (size < 0)
+            return false;
+
+        text.resize((size_t)size);
+        file.seekg(0);
+        return (bool)file.read(&text[0], size);
+    }
+
+private:
+    static std::string normalized(const std::string& path)
+    {
+        std::error_code ec;
+        std::filesystem::path p = std::filesystem::weakly_canonical(path, ec);
+        return ec ? path : p.string();
+    }
+
+    // #include "name" or #include <name>, returns the name or an empty string
+    static std::string includeName(const std::string& line)
+    {
+        size_t i = line.find_first_not_of(" \t");
+        if (i == std::string::npos || line[i] != '#')
+            return "";
+
+        i = line.find_first_not_of(" \t", i + 1);
+        if (i == std::string::npos || line.compare(i, 7, "include") != 0)
+            return "";
+
+        size_t open = line.find_first_of("\"<", i + 7);
+        if (open == std::string::npos)
+            return "";
+
+        size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+        if (close == std::string::npos)
+            return "";
+
+        return line.substr(open + 1, close - open - 1);
+    }
+
+    static bool isVersion(const std::string& line)
+    {
+        size_t i = line.find_first_not_of(" \t");
+        if (i == std::string::npos || line[i] != '#')
+            return false;
+
+        i = line.find_first_not_of(" \t", i + 1);
+        return i != std::string::npos && line.compare(i, 7, "version") == 0;
+    }
+
+    static void emitDefines(const std::vector<std::string>& defines, std::string& out)
+    {
+        for (const std::string& d : defines)
+        {
+            size_t eq = d.find('=');
+            out += "#define ";
+            out += eq == std::string::npos ? d + " 1" : d.substr(0, eq) + " " + d.substr(eq + 1);
+            out += '\n';
+        }
+    }
+
+    // defines is only passed for the main file
+    bool expand(const std::string& path, const std::string& source, int fileIndex, const std::vector<std::string>* defines,
+        std::vector<std::string>& stack, std::string& out)
+    {
+        if (stack.size() > MAX_INCLUDE_DEPTH)
+        {
+            error = "include depth exceeded in " + path;
+            return false;
+        }
+
+        bool sawVersion = false;
+        int lineNumber = 0;
+
+        for (size_t pos = 0; pos < source.size(); )
+        {
+            size_t end = source.find('\n', pos);
+            if (end == std::string::npos)
+                end = source.size();
+
+            std::string line = source.substr(pos, end - pos);
+            pos = end + 1;
+            lineNumber++;
+
+            std::string name = includeName(line);
+
+            if (!name.empty())
+            {
+                std::string includePath = (std::filesystem::path(path).parent_path() / name).string();
+                std::string key = normalized(includePath);
+
+                if (std::find(stack.begin(), stack.end(), key) != stack.end())
+                {
+                    error = "recursive include of " + includePath + " in " + path;
+                    return false;
+                }
+
+                std::string text;
+                if (!readFile(includePath, text))
+                {
+                    error = "can't read " + includePath + " included from " + path + "(" + std::to_string(lineNumber) + ")";
+                    return false;
+                }
+
+                int index = (int)files.size();
+                files.push_back(includePath);
+
+                out += "#line 1 " + std::to_string(index) + "\n";
+
+                stack.push_back(key);
+                if (!expand(includePath, text, index, nullptr, stack, out))
+                    return false;
+                stack.pop_back();
+
+                out += "\n#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+                continue;
+            }
+
+            out += line;
+            out += '\n';
+
+            if (defines && !sawVersion && isVersion(line))
+            {
+                sawVersion = true;
+                emitDefines(*defines, out);
+                out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+        }
+
+        // no #version (unusual), the defines still have to come before any use
+        if (defines && !sawVersion && !defines->empty())
+        {
+            std::string prefix;
+            emitDefines(*defines, prefix);
+            out.insert(0, prefix + "#line 1 0\n");
+        }
+
+        return true;
+    }
+};
@@ -3,129 +3,472 @@
 
 #include <glad/glad.h>
 
+#include "shader_preprocessor.h"
+#include "trace.h"
+
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
 
 class Shader
 {
 public:
-    unsigned int ID;
-    const char* vertexPath;
-    const char* fragmentPath;
+    // uniforms every renderer sets on every draw, their locations are cached in an array so no string lookup is needed
+    enum StandardUniform { UNIFORM_M, UNIFORM_V, UNIFORM_P, UNIFORM_MVP, UNIFORM_COUNT };
+
+    // uniform buffer binding point of the per frame "Camera" block (see frame_uniforms.h)
+    static const unsigned int CAMERA_BLOCK_BINDING = 0;
+
+    // when true, all lookups go back to glGetUniformLocation (useful for measuring what the cache saves)
+    static inline bool bypassUniformCache = false;
+
+    // set at startup when the driver has ARB/KHR_parallel_shader_compile, links then finish in the background
+    // and poll() picks them up, otherwise reload() blocks until the program is linked like it always did
+    static inline bool parallelCompile = false;
+
+    // linked programs are stored here by glGetProgramBinary, named after a hash of the sources and the driver
+    static inline std::string binaryCacheDir = "shader_cache";
+
+    unsigned int ID = 0;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> defines; // permutation, e.g. { "INSTANCED" } or { "ALPHA_TEST", "MAX_BONES=64" }
 
 public:
-    char vtext[4096], ftext[4096];
+    // shader sources, sized to what was loaded (the imGui editor grows them as needed)
+    std::string vtext, ftext;
 
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
 
-    Shader() {}
+    Shader() { live().push_back(this); }
+
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    ~Shader()
+    {
+        live().erase(std::find(live().begin(), live().end(), this));
+
+        discardPending();
+        if (ID)
+            glDeleteProgram(ID);
+    }
 
-    Shader(const char* vPath, const char* fPath)
+    // build = false leaves reading and compiling to the caller (see ShaderVariants::precompile)
+    Shader(const std::string& vPath, const std::string& fPath, const std::vector<std::string>& defs = {}, bool build = true)
     {
+        live().push_back(this);
+
         vertexPath = vPath;
         fragmentPath = fPath;
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
+        defines = defs;
+
+        if (build)
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            readSources();
+            reload();
         }
-        catch (std::ifstream::failure& e)
+    }
+    // every Shader that currently exists, e.g. for the file watcher to find the ones using an edited file
+    static const std::vector<Shader*>& liveShaders() { return live(); }
+    // the files the sources come from, including everything they #include
+    std::vector<std::string> sourceFiles() const
+    {
+        std::vector<std::string> files;
+        if (!vertexPath.empty())
+            files.push_back(vertexPath);
+        if (!fragmentPath.empty())
+            files.push_back(fragmentPath);
+        files.insert(files.end(), includedFiles.begin(), includedFiles.end());
+        return files;
+    }
+    // (re)reads the vertex/fragment source code into vtext/ftext, false if a file couldn't be read
+    // ------------------------------------------------------------------------
+    bool readSources()
+    {
+        if (vertexPath.empty() || fragmentPath.empty())
+            return false;
+
+        // retrieve the vertex/fragment source code from filePath
+        std::string vertexCode, fragmentCode;
+
+        if (!ShaderPreprocessor::readFile(vertexPath, vertexCode) || !ShaderPreprocessor::readFile(fragmentPath, fragmentCode))
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            return false;
         }
-        int myLen = vertexCode.length();
 
-        memcpy(vtext, vertexCode.c_str(), vertexCode.length());
-        vtext[vertexCode.length()] = 0;
-        memcpy(ftext, fragmentCode.c_str(), fragmentCode.length());
-        ftext[fragmentCode.length()] = 0;
+        // both files read fine, take over their buffers
+        vtext = std::move(vertexCode);
+        ftext = std::move(fragmentCode);
 
-        reload();
+        return true;
+    }
+    // picks up edits made to the files (the imGui editor's text is replaced)
+    void reloadFromFiles() {
+        if (readSources())
+            reload();
     }
     void reload() {
-        reload(vtext, ftext);
+        Expanded e = expand();
+        build(e);
+    }
+    // vtext/ftext with includes resolved and the defines applied, touches no GL state so it can run on any thread
+    // ------------------------------------------------------------------------
+    struct Expanded {
+        std::string vertex, fragment;
+        std::vector<std::string> includes;
+        bool ok = false;
+    };
+    Expanded expand() const
+    {
+        G4G_TRACE_SCOPE("Shader::expand");
+
+        Expanded e;
+        ShaderPreprocessor vpp, fpp;
+
+        if (!vpp.run(vertexPath, vtext, defines, e.vertex) || !fpp.run(fragmentPath, ftext, defines, e.fragment))
+        {
+            std::cout << "ERROR::SHADER::PREPROCESS " << vpp.error << fpp.error << std::endl;
+            return e;
+        }
+
+        // [0] is the main file itself
+        e.includes.assign(vpp.files.begin() + 1, vpp.files.end());
+        e.includes.insert(e.includes.end(), fpp.files.begin() + 1, fpp.files.end());
+        e.ok = true;
+        return e;
+    }
+    // compiles the result of expand(), on the GL thread
+    void build(const Expanded& e)
+    {
+        if (!e.ok)
+            return;
+
+        includedFiles = e.includes;
+        reload(e.vertex.c_str(), e.fragment.c_str());
     }
+    // starts building a new program from the sources, the current one stays in use until the new one has linked
+    // (a program that fails to compile or link never replaces a working one)
     void reload(const char* vShaderCode, const char* fShaderCode) {
-        
+        G4G_TRACE_SCOPE("Shader::reload");
+
+        discardPending(); // a newer edit supersedes a link still in flight
+
+        pending.hash = sourceHash(vShaderCode, fShaderCode);
+        pending.program = glCreateProgram();
+
+        // warm start, the driver takes the binary it handed out last time and no compiler runs at all
+        if (loadProgramBinary(pending.program, pending.hash))
+        {
+            activatePending();
+            return;
+        }
+
         // compile shaders
-        unsigned int vertex, fragment;
         // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        pending.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(pending.vertex);
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        pending.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(pending.fragment);
+        // shader Program, compile status is only looked at once the link is done so nothing waits on the compiler here
+        glAttachShader(pending.program, pending.vertex);
+        glAttachShader(pending.program, pending.fragment);
+        if (programBinarySupported())
+            glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(pending.program);
+
+        if (!parallelCompile)
+            poll();
     }
+    // installs the pending program once the driver has finished linking it, never blocks when parallelCompile is set
+    // returns true if a new program was installed
+    // ------------------------------------------------------------------------
+    bool poll()
+    {
+        if (!pending.program)
+            return false;
+
+        if (parallelCompile)
+        {
+            int done = GL_FALSE;
+            glGetProgramiv(pending.program, GL_COMPLETION_STATUS_ARB, &done);
+            if (!done)
+                return false;
+        }
+
+        G4G_TRACE_SCOPE("Shader::poll");
+
+        int linked = GL_FALSE;
+        glGetProgramiv(pending.program, GL_LINK_STATUS, &linked);
+
+        if (!linked)
+        {
+            checkCompileErrors(pending.vertex, "VERTEX");
+            checkCompileErrors(pending.fragment, "FRAGMENT");
+            checkCompileErrors(pending.program, "PROGRAM");
+            discardPending();
+            return false;
+        }
+
+        saveProgramBinary(pending.program, pending.hash);
+        activatePending();
+        return true;
+    }
+    // a link is still in flight
+    bool compiling() const { return pending.program != 0; }
+    // there is a linked program to draw with
+    bool ready() const { return ID != 0; }
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
     {
         glUseProgram(ID);
     }
+    // uniform locations, served from the cache built at link time (-1 if the program has no such uniform)
+    // ------------------------------------------------------------------------
+    int uniformLocation(const std::string& name) const
+    {
+        if (bypassUniformCache)
+            return glGetUniformLocation(ID, name.c_str());
+
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    int uniformLocation(StandardUniform u) const
+    {
+        if (bypassUniformCache)
+            return glGetUniformLocation(ID, standardUniformNames[u]);
+
+        return standardLocations[u];
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(uniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(uniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(uniformLocation(name), value);
     }
+    // writes the (edited) sources back to the files they were loaded from
     void saveShaders() {
+        if (vertexPath.empty() || fragmentPath.empty())
+            return;
+
         std::ofstream myfile;
 
-        myfile.open("data/vertex.lgsl");
+        myfile.open(vertexPath);
         myfile << vtext;
         myfile.close();
 
-        myfile.open("data/fragment.lgsl");
+        myfile.open(fragmentPath);
         myfile << ftext;
         myfile.close();
     }
 
 private:
+    static std::vector<Shader*>& live()
+    {
+        static std::vector<Shader*> shaders;
+        return shaders;
+    }
+
+    static inline const char* standardUniformNames[UNIFORM_COUNT] = { "m", "v", "p", "mvp" };
+
+    std::vector<std::string> includedFiles; // as of the last successful expand()
+
+    // the program being built by reload(), installed into ID by poll()
+    struct Pending {
+        unsigned int program = 0, vertex = 0, fragment = 0;
+        uint64_t hash = 0;
+    } pending;
+
+    std::unordered_map<std::string, int> uniformLocations;
+    int standardLocations[UNIFORM_COUNT] = { -1, -1, -1, -1 };
+
+    // the pending program replaces the current one
+    // ------------------------------------------------------------------------
+    void activatePending()
+    {
+        unsigned int oldID = ID;
+        ID = pending.program;
+        pending.program = 0;
+        discardPending();
+
+        // the previous program (if any) is replaced by the new one
+        if (oldID)
+            glDeleteProgram(oldID);
+
+        // glsl 4.1 has no layout(binding = n) for blocks, so hook the camera block up here
+        unsigned int cameraBlock = glGetUniformBlockIndex(ID, "Camera");
+        if (cameraBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, cameraBlock, CAMERA_BLOCK_BINDING);
+
+        cacheUniformLocations();
+    }
+
+    void discardPending()
+    {
+        // deleting shaders that are attached only flags them, they go away with the program
+        if (pending.vertex)
+            glDeleteShader(pending.vertex);
+        if (pending.fragment)
+            glDeleteShader(pending.fragment);
+        if (pending.program)
+            glDeleteProgram(pending.program);
+
+        pending = Pending();
+    }
+
+    // program binaries
+    // ------------------------------------------------------------------------
+    static bool programBinarySupported()
+    {
+        // core in 4.1 but our loader only fetches the entry points when the extension is advertised
+        if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+            return false;
+
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // FNV-1a over both sources and the driver strings, binaries are only valid for the driver that produced them
+    static uint64_t sourceHash(const char* vShaderCode, const char* fShaderCode)
+    {
+        uint64_t h = 14695981039346656037ull;
+
+        auto add = [&h](const char* text) {
+            for (const char* c = text ? text : ""; *c; c++)
+                h = (h ^ (uint8_t)*c) * 1099511628211ull;
+            h = (h ^ 0xFF) * 1099511628211ull; // separator, so moving text between the parts changes the hash
+        };
+
+        add(vShaderCode);
+        add(fShaderCode);
+        add((const char*)glGetString(GL_VENDOR));
+        add((const char*)glGetString(GL_RENDERER));
+        add((const char*)glGetString(GL_VERSION));
+
+        return h;
+    }
+
+    static std::string binaryPath(uint64_t hash)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+        return (std::filesystem::path(binaryCacheDir) / name).string();
+    }
+
+    // file layout: binary format (uint32), then the blob glGetProgramBinary returned
+    static bool loadProgramBinary(unsigned int program, uint64_t hash)
+    {
+        if (!programBinarySupported())
+            return false;
+
+        std::ifstream file(binaryPath(hash), std::ios::binary);
+        if (!file)
+            return false;
+
+        uint32_t format = 0;
+        if (!file.read((char*)&format, sizeof(format)))
+            return false;
+
+        std::vector<char> blob((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (blob.empty())
+            return false;
+
+        glProgramBinary(program, format, blob.data(), (GLsizei)blob.size());
+
+        // a driver update can reject old binaries, then we just compile from source
+        int linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    static void saveProgramBinary(unsigned int program, uint64_t hash)
+    {
+        if (!programBinarySupported())
+            return;
+
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> blob(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, blob.data());
+
+        std::error_code ec;
+        std::filesystem::create_directories(binaryCacheDir, ec);
+
+        std::ofstream file(binaryPath(hash), std::ios::binary);
+        uint32_t f = format;
+        file.write((const char*)&f, sizeof(f));
+        file.write(blob.data(), length);
+
+        if (!file)
+            std::cout << "ERROR::SHADER::BINARY_CACHE_WRITE_FAILED " << binaryPath(hash) << std::endl;
+    }
+
+    // query every active uniform of the freshly linked program once, instead of asking the driver on every draw
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+
+        int count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+
+        for (int i = 0; i < count; i++)
+        {
+            int length = 0, size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, i, maxLength, &length, &size, &type, &name[0]);
+
+            std::string uniformName = name.substr(0, length);
+            int location = glGetUniformLocation(ID, uniformName.c_str());
+
+            if (location < 0) // uniforms inside blocks have no location
+                continue;
+
+            uniformLocations[uniformName] = location;
+
+            // arrays are reported as "name[0]", make them reachable by their plain name too
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+                uniformLocations[uniformName.substr(0, uniformName.size() - 3)] = location;
+        }
+
+        for (int u = 0; u < UNIFORM_COUNT; u++)
+        {
+            auto it = uniformLocations.find(standardUniformNames[u]);
+            standardLocations[u] = it != uniformLocations.end() ? it->second : -1;
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,83 @@
+#include "shader_s.h"
+#include "job_system.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma once
+// one Shader per (files, defines) permutation, built the first time it is asked for and shared from then on
+//
+//   Shader* s = variants.get("data/vertex.lgsl", "data/fragment.lgsl", { "INSTANCED" });
+//
+// the order of the defines doesn't matter. on disk, compiled programs are already keyed by a hash of the expanded
+// source (which contains the defines), so a variant that was built on a previous run loads as a program binary
+struct ShaderVariant {
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> defines;
+};
+
+class ShaderVariants {
+
+    std::map<std::string, std::unique_ptr<Shader>> variants;
+
+public:
+    Shader* get(const std::string& vertexPath, const std::string& fragmentPath, std::vector<std::string> defines = {})
+    {
+        std::sort(defines.begin(), defines.end());
+
+        std::unique_ptr<Shader>& s = variants[key(vertexPath, fragmentPath, defines)];
+        if (!s)
+            s = std::make_unique<Shader>(vertexPath, fragmentPath, defines);
+
+        return s.get();
+    }
+
+    // builds a whole set of variants up front: the files are read and preprocessed on the job system, then every
+    // program is handed to the driver without waiting on any of them, so with parallel shader compile they all link
+    // at the same time (Shader::poll picks them up)
+    void precompile(const std::vector<ShaderVariant>& list)
+    {
+        G4G_TRACE_SCOPE("ShaderVariants::precompile");
+
+        std::vector<Shader*> added;
+
+        for (ShaderVariant v : list)
+        {
+            std::sort(v.defines.begin(), v.defines.end());
+
+            std::unique_ptr<Shader>& s = variants[key(v.vertexPath, v.fragmentPath, v.defines)];
+            if (!s)
+            {
+                s = std::make_unique<Shader>(v.vertexPath, v.fragmentPath, v.defines, false);
+                added.push_back(s.get());
+            }
+        }
+
+        std::vector<Shader::Expanded> expanded(added.size());
+
+        JobSystem::instance().parallelFor(added.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                if (added[i]->readSources())
+                    expanded[i] = added[i]->expand();
+        });
+
+        // GL calls stay on this thread
+        for (size_t i = 0; i < added.size(); i++)
+            added[i]->build(expanded[i]);
+    }
+
+    size_t size() const { return variants.size(); }
+
+private:
+    static std::string key(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& defines)
+    {
+        std::string k = vertexPath + '\n' + fragmentPath;
+        for (const std::string& d : defines)
+            k += '\n' + d;
+        return k;
+    }
+};
@@ -0,0 +1,230 @@
+#include "shader_s.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#pragma once
+// hot reload for shader files edited outside the app
+//
+// a background thread waits for changes to any file used by a live Shader (inotify on Linux, comparing modification
+// times every POLL_INTERVAL elsewhere) and records the changed paths. apply(), called once per frame on the GL thread,
+// reloads only the shaders that use one of those files, the reloads then link in the background (see Shader::poll)
+class ShaderWatcher {
+
+public:
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{ 250 };
+
+private:
+    std::thread thread;
+    std::atomic<bool> quitting{ false };
+
+    std::mutex lock; // guards everything below, shared with the watcher thread
+    std::set<std::string> watched; // canonical paths of all files used by live shaders
+    unsigned int watchedVersion = 0;
+    std::set<std::string> changed;
+
+public:
+    unsigned int reloadCount = 0;
+
+    ShaderWatcher()
+    {
+        syncFiles();
+        thread = std::thread([this] { run(); });
+    }
+
+    ~ShaderWatcher()
+    {
+        quitting = true;
+        thread.join();
+    }
+
+    // GL thread, once per frame
+    void apply()
+    {
+        syncFiles(); // shaders may have come and gone
+
+        std::set<std::string> edited;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (changed.empty())
+                return;
+            edited.swap(changed);
+        }
+
+        G4G_TRACE_SCOPE("ShaderWatcher::apply");
+
+        for (Shader* s : Shader::liveShaders())
+        {
+            for (const std::string& file : s->sourceFiles())
+            {
+                if (edited.count(canonical(file)))
+                {
+                    std::cout << "Reloading " << s->vertexPath << " + " << s->fragmentPath << std::endl;
+                    s->reloadFromFiles();
+                    reloadCount++;
+                    break;
+                }
+            }
+        }
+    }
+
+    size_t watchedCount()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return watched.size();
+    }
+
+private:
+    static std::string canonical(const std::string& path)
+    {
+        std::error_code ec;
+        std::filesystem::path p = std::filesystem::weakly_canonical(path, ec);
+        return ec ? path : p.string();
+    }
+
+    void syncFiles()
+    {
+        std::set<std::string> files;
+        for (Shader* s : Shader::liveShaders())
+            for (const std::string& file : s->sourceFiles())
+                files.insert(canonical(file));
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (files != watched)
+        {
+            watched.swap(files);
+            watchedVersion++;
+        }
+    }
+
+    void markChanged(const std::string& path)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (watched.count(path))
+            changed.insert(path);
+    }
+
+#ifdef __linux__
+    // editors often save by writing a new file and renaming it over the old one, which a watch on the file itself
+    // would miss, so the directories are watched and the events filtered by name
+    void run()
+    {
+        G4G_TRACE_THREAD_NAME("Shader watcher");
+
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED, falling back to polling" << std::endl;
+            runPolling();
+            return;
+        }
+
+        std::map<int, std::string> directories; // watch descriptor -> directory
+        unsigned int version = ~0u;
+
+        alignas(inotify_event) char buffer[4096];
+
+        while (!quitting)
+        {
+            std::set<std::string> dirs;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (version != watchedVersion)
+                {
+                    version = watchedVersion;
+                    for (const std::string& file : watched)
+                        dirs.insert(std::filesystem::path(file).parent_path().string());
+                }
+            }
+
+            if (!dirs.empty())
+            {
+                for (auto& d : directories)
+                    inotify_rm_watch(fd, d.first);
+                directories.clear();
+
+                for (const std::string& dir : dirs)
+                {
+                    int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                    if (wd >= 0)
+                        directories[wd] = dir;
+                }
+            }
+
+            // wake up regularly to notice quitting and new files
+            pollfd p = { fd, POLLIN, 0 };
+            if (::poll(&p, 1, (int)POLL_INTERVAL.count()) <= 0)
+                continue;
+
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* e = buffer; e < buffer + length; )
+                {
+                    inotify_event* event = (inotify_event*)e;
+
+                    auto dir = directories.find(event->wd);
+                    if (dir != directories.end() && event->len)
+                        markChanged((std::filesystem::path(dir->second) / event->name).string());
+
+                    e += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        close(fd);
+    }
+#else
+    void run()
+    {
+        G4G_TRACE_THREAD_NAME("Shader watcher");
+        runPolling();
+    }
+#endif
+
+    // portable fallback, compares modification times
+    void runPolling()
+    {
+        std::map<std::string, std::filesystem::file_time_type> times;
+
+        while (!quitting)
+        {
+            std::set<std::string> files;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                files = watched;
+            }
+
+            for (const std::string& file : files)
+            {
+                std::error_code ec;
+                auto time = std::filesystem::last_write_time(file, ec);
+                if (ec)
+                    continue;
+
+                auto it = times.find(file);
+                if (it != times.end() && it->second != time)
+                    markChanged(file);
+
+                times[file] = time;
+            }
+
+            std::this_thread::sleep_for(POLL_INTERVAL);
+        }
+    }
+};
@@ -0,0 +1,81 @@
+#include "renderer.h"
+#include "cube_map.h"
+#include "trace.h"
+
+#pragma once
+// a cube map drawn around the camera, after everything else
+//
+// the vertex shader (data/skybox_vertex.lgsl) drops the view translation and writes z = w, so every sky fragment
+// lands exactly on the far plane. with GL_LEQUAL and depth writes off it only shades the pixels the scene left
+// empty, drawing it last saves the fill rate the hidden parts of the sky would cost
+class SkyboxRenderer : public renderer {
+
+    const CubeMapTexture* cubeMap;
+
+public:
+    SkyboxRenderer(Shader* shader, const CubeMapTexture* cube) : cubeMap(cube)
+    {
+        static const float corners[8 * 3] = {
+            -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,   1.0f,  1.0f, -1.0f,
+            -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,   1.0f,  1.0f,  1.0f };
+
+        // seen from the inside
+        static const unsigned int faces[36] = {
+            0,1,2, 2,1,3,  4,6,5, 5,6,7,  0,2,4, 4,2,6,  1,5,3, 3,5,7,  0,4,1, 1,4,5,  2,3,6, 6,3,7 };
+
+        modelMatrix = glm::mat4(1.0f);
+        myShader = shader;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        indexCount = 36;
+
+        glBindVertexArray(0);
+    }
+
+    ~SkyboxRenderer()
+    {
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+    }
+
+    // call after the rest of the scene, with the depth test on
+    void render(glm::mat4 vMat, glm::mat4 pMat, double /*deltaTime*/) override
+    {
+        G4G_TRACE_SCOPE("SkyboxRenderer::render");
+
+        if (!myShader->ready() || !*cubeMap)
+            return;
+
+        myShader->use();
+
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->texture());
+        glBindVertexArray(VAO);
+
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+
+        draw(vMat, pMat);
+
+        glDepthMask(GL_TRUE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+    // everything comes from the Camera block
+    void draw(const glm::mat4& /*vMat*/, const glm::mat4& /*pMat*/) override
+    {
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    }
+};
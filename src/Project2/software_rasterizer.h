@@ -0,0 +1,651 @@
+#include "job_system.h"
+#include "trace.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define G4G_SWR_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define G4G_SWR_SSE2 1
+#endif
+
+#pragma once
+// CPU triangle rasterizer drawing into an RGB8 or RGBA8 image such as imageBuff, for checking shading ideas without a GPU
+//
+// - vertices are transformed and triangles clipped (near/far and a guard band) on the job system
+// - every triangle is set up once: edge functions on a 1/16 pixel grid, plane equations for depth, 1/w and varying/w
+// - triangles are binned into BIN_SIZE squares, bins are rasterized in parallel and each keeps submission order
+// - inside a bin, 8x8 tiles are trivially rejected or accepted per edge, covered rows of 8 pixels go through
+//   coverage, depth test and perspective correct interpolation 8 (AVX2) or 2x4 (SSE2) pixels at a time
+//
+// fill convention matches GL: pixel centers at +0.5 and a top-left rule, so meshes have no cracks or double hits.
+// depth is NDC z, cleared to 1 and tested with LEQUAL
+namespace swr {
+
+// 8 lanes of int32 / float, one row of a tile
+// ------------------------------------------------------------------------
+#if defined(G4G_SWR_AVX2)
+struct I8 { __m256i v; };
+struct F8 { __m256 v; };
+
+inline I8 set1(int32_t a) { return { _mm256_set1_epi32(a) }; }
+inline I8 lanes(int32_t step) { return { _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)) }; }
+inline I8 operator+(I8 a, I8 b) { return { _mm256_add_epi32(a.v, b.v) }; }
+inline I8 operator&(I8 a, I8 b) { return { _mm256_and_si256(a.v, b.v) }; }
+inline I8 operator>(I8 a, I8 b) { return { _mm256_cmpgt_epi32(a.v, b.v) }; }
+inline int movemask(I8 a) { return _mm256_movemask_ps(_mm256_castsi256_ps(a.v)); }
+
+inline F8 set1(float a) { return { _mm256_set1_ps(a) }; }
+inline F8 lanes(float step) { return { _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)) }; }
+inline F8 operator+(F8 a, F8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline F8 operator*(F8 a, F8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline F8 operator/(F8 a, F8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline I8 operator<=(F8 a, F8 b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)) }; }
+inline F8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+inline void store(float* p, F8 a) { _mm256_storeu_ps(p, a.v); }
+inline F8 select(I8 m, F8 a, F8 b) { return { _mm256_blendv_ps(b.v, a.v, _mm256_castsi256_ps(m.v)) }; }
+#elif defined(G4G_SWR_SSE2)
+struct I8 { __m128i lo, hi; };
+struct F8 { __m128 lo, hi; };
+
+inline I8 set1(int32_t a) { return { _mm_set1_epi32(a), _mm_set1_epi32(a) }; }
+inline I8 lanes(int32_t step) { return { _mm_setr_epi32(0, step, 2 * step, 3 * step), _mm_setr_epi32(4 * step, 5 * step, 6 * step, 7 * step) }; }
+inline I8 operator+(I8 a, I8 b) { return { _mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi) }; }
+inline I8 operator&(I8 a, I8 b) { return { _mm_and_si128(a.lo, b.lo), _mm_and_si128(a.hi, b.hi) }; }
+inline I8 operator>(I8 a, I8 b) { return { _mm_cmpgt_epi32(a.lo, b.lo), _mm_cmpgt_epi32(a.hi, b.hi) }; }
+inline int movemask(I8 a) { return _mm_movemask_ps(_mm_castsi128_ps(a.lo)) | (_mm_movemask_ps(_mm_castsi128_ps(a.hi)) << 4); }
+
+inline F8 set1(float a) { return { _mm_set1_ps(a), _mm_set1_ps(a) }; }
+inline F8 lanes(float step) { return { _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3)), _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(4, 5, 6, 7)) }; }
+inline F8 operator+(F8 a, F8 b) { return { _mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi) }; }
+inline F8 operator*(F8 a, F8 b) { return { _mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi) }; }
+inline F8 operator/(F8 a, F8 b) { return { _mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi) }; }
+inline I8 operator<=(F8 a, F8 b) { return { _mm_castps_si128(_mm_cmple_ps(a.lo, b.lo)), _mm_castps_si128(_mm_cmple_ps(a.hi, b.hi)) }; }
+inline F8 load(const float* p) { return { _mm_loadu_ps(p), _mm_loadu_ps(p + 4) }; }
+inline void store(float* p, F8 a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+inline F8 select(I8 m, F8 a, F8 b)
+{
+    __m128 lo = _mm_castsi128_ps(m.lo), hi = _mm_castsi128_ps(m.hi);
+    return { _mm_or_ps(_mm_and_ps(lo, a.lo), _mm_andnot_ps(lo, b.lo)), _mm_or_ps(_mm_and_ps(hi, a.hi), _mm_andnot_ps(hi, b.hi)) };
+}
+#else
+// plain loops, compilers vectorize most of these on their own
+struct I8 { int32_t v[8]; };
+struct F8 { float v[8]; };
+
+inline I8 set1(int32_t a) { I8 r; for (int i = 0; i < 8; i++) r.v[i] = a; return r; }
+inline I8 lanes(int32_t step) { I8 r; for (int i = 0; i < 8; i++) r.v[i] = step * i; return r; }
+inline I8 operator+(I8 a, I8 b) { for (int i = 0; i < 8; i++) a.v[i] += b.v[i]; return a; }
+inline I8 operator&(I8 a, I8 b) { for (int i = 0; i < 8; i++) a.v[i] &= b.v[i]; return a; }
+inline I8 operator>(I8 a, I8 b) { for (int i = 0; i < 8; i++) a.v[i] = a.v[i] > b.v[i] ? -1 : 0; return a; }
+inline int movemask(I8 a) { int m = 0; for (int i = 0; i < 8; i++) m |= (a.v[i] < 0) << i; return m; }
+
+inline F8 set1(float a) { F8 r; for (int i = 0; i < 8; i++) r.v[i] = a; return r; }
+inline F8 lanes(float step) { F8 r; for (int i = 0; i < 8; i++) r.v[i] = step * i; return r; }
+inline F8 operator+(F8 a, F8 b) { for (int i = 0; i < 8; i++) a.v[i] += b.v[i]; return a; }
+inline F8 operator*(F8 a, F8 b) { for (int i = 0; i < 8; i++) a.v[i] *= b.v[i]; return a; }
+inline F8 operator/(F8 a, F8 b) { for (int i = 0; i < 8; i++) a.v[i] /= b.v[i]; return a; }
+inline I8 operator<=(F8 a, F8 b) { I8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] <= b.v[i] ? -1 : 0; return r; }
+inline F8 load(const float* p) { F8 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void store(float* p, F8 a) { memcpy(p, a.v, sizeof(a.v)); }
+inline F8 select(I8 m, F8 a, F8 b) { for (int i = 0; i < 8; i++) if (m.v[i]) b.v[i] = a.v[i]; return b; }
+#endif
+
+inline const char* simdName()
+{
+#if defined(G4G_SWR_AVX2)
+    return "AVX2";
+#elif defined(G4G_SWR_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+static const int MAX_VARYINGS = 8;
+
+// position plus whatever the fragment stage wants interpolated (the default one reads varyings 0-2 as RGB)
+struct Vertex {
+    glm::vec3 position;
+    float varyings[MAX_VARYINGS];
+};
+
+// called for every pixel that passes the depth test when set, returns RGB in 0..1
+typedef std::function<glm::vec3(const float* varyings, int x, int y)> FragmentShader;
+
+class Rasterizer {
+
+public:
+    static constexpr int SUBPIXEL_BITS = 4;
+    static constexpr int SUBPIXEL = 1 << SUBPIXEL_BITS;
+    static constexpr int TILE_SIZE = 8;
+    static constexpr int BIN_SIZE = 64;
+    static constexpr int GUARD_BAND = 8192;       // pixels outside the viewport before triangles get clipped
+    static constexpr int TRIANGLES_PER_JOB = 256;
+
+    struct Stats {
+        size_t triangles = 0; // submitted
+        size_t setup = 0;     // after culling and clipping
+        size_t tiles = 0;     // 8x8 tiles visited
+        size_t pixels = 0;    // written
+    };
+
+    bool cullBackFaces = false; // counter clockwise is front, like glFrontFace(GL_CCW)
+    bool depthTest = true;
+    int varyingCount = 3;
+    FragmentShader fragmentShader;
+
+    Stats stats;
+
+private:
+    struct ClipVertex {
+        glm::vec4 clip;
+        float varyings[MAX_VARYINGS];
+    };
+
+    // value at pixel center (x, y) is base + dx * (x - x0) + dy * (y - y0)
+    struct Plane {
+        float base, dx, dy;
+
+        double at(double x, double y, double x0, double y0) const { return base + dx * (x - x0) + dy * (y - y0); }
+    };
+
+    struct Triangle {
+        int64_t A[3], B[3], C[3]; // E = A*x + B*y + C on the subpixel grid, > 0 inside
+        int32_t bias[3];          // 1 on edges that don't own their pixels (not top or left)
+        int minX, minY, maxX, maxY;
+        float x0, y0;
+        Plane z, invW, varyings[MAX_VARYINGS];
+    };
+
+    uint8_t* pixels = nullptr;
+    int width = 0, height = 0, stride = 0, channels = 3;
+
+    int depthStride = 0; // padded to whole rows of 8
+    std::vector<float> depth;
+
+    int binsX = 0, binsY = 0;
+
+    std::vector<ClipVertex> clipVertices;
+    std::vector<std::vector<Triangle>> triangles;              // per setup job
+    std::vector<std::vector<std::vector<uint32_t>>> binLists;  // [job][bin] -> triangles of that job
+
+public:
+    // pixels: top row first, stride in bytes, 3 (RGB) or 4 (RGBA) channels
+    void setTarget(uint8_t* target, int w, int h, int rowStride, int channelCount = 3)
+    {
+        pixels = target;
+        width = w;
+        height = h;
+        stride = rowStride;
+        channels = channelCount;
+
+        depthStride = (w + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+        depth.assign((size_t)depthStride * ((h + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE), 1.0f);
+
+        binsX = (w + BIN_SIZE - 1) / BIN_SIZE;
+        binsY = (h + BIN_SIZE - 1) / BIN_SIZE;
+    }
+
+    void clear(const glm::vec3& color, float clearDepth = 1.0f)
+    {
+        uint8_t c[4] = { toByte(color.r), toByte(color.g), toByte(color.b), 255 };
+
+        // one row is built by hand, the rest are copies of it
+        std::vector<uint8_t> clearRow((size_t)width * channels);
+        for (int x = 0; x < width; x++)
+            memcpy(&clearRow[(size_t)x * channels], c, channels);
+
+        JobSystem::instance().parallelFor(height, 16, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++)
+            {
+                memcpy(pixels + y * stride, clearRow.data(), clearRow.size());
+                std::fill(&depth[y * depthStride], &depth[y * depthStride] + depthStride, clearDepth);
+            }
+        });
+    }
+
+    float depthAt(int x, int y) const { return depth[(size_t)y * depthStride + x]; }
+
+    // indexed triangle list, counter clockwise front faces
+    void draw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& mvp)
+    {
+        G4G_TRACE_SCOPE("swr::draw");
+
+        if (!pixels || indices.size() < 3)
+            return;
+
+        JobSystem& jobs = JobSystem::instance();
+
+        // vertex stage
+        clipVertices.resize(vertices.size());
+
+        jobs.parallelFor(vertices.size(), 1024, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                clipVertices[i].clip = mvp * glm::vec4(vertices[i].position, 1.0f);
+                memcpy(clipVertices[i].varyings, vertices[i].varyings, sizeof(float) * varyingCount);
+            }
+        });
+
+        // clip, set up and bin, every job keeps its own triangles and bin lists so nothing is shared
+        size_t triangleCount = indices.size() / 3;
+        size_t jobCount = (triangleCount + TRIANGLES_PER_JOB - 1) / TRIANGLES_PER_JOB;
+        size_t binCount = (size_t)binsX * binsY;
+
+        triangles.resize(jobCount);
+        binLists.resize(jobCount);
+
+        jobs.parallelFor(jobCount, 1, [&](size_t begin, size_t end) {
+            for (size_t job = begin; job < end; job++)
+            {
+                std::vector<Triangle>& tris = triangles[job];
+                std::vector<std::vector<uint32_t>>& bins = binLists[job];
+
+                tris.clear();
+                bins.resize(binCount);
+                for (auto& b : bins)
+                    b.clear();
+
+                size_t first = job * TRIANGLES_PER_JOB, last = std::min(triangleCount, first + TRIANGLES_PER_JOB);
+
+                for (size_t t = first; t < last; t++)
+                {
+                    const ClipVertex& a = clipVertices[indices[t * 3 + 0]];
+                    const ClipVertex& b = clipVertices[indices[t * 3 + 1]];
+                    const ClipVertex& c = clipVertices[indices[t * 3 + 2]];
+
+                    clipAndSetup(a, b, c, tris);
+                }
+
+                for (uint32_t i = 0; i < tris.size(); i++)
+                    binTriangle(tris[i], i, bins);
+            }
+        });
+
+        // raster stage, one bin per job
+        std::atomic<size_t> tiles{ 0 }, written{ 0 };
+
+        jobs.parallelFor(binCount, 1, [&](size_t begin, size_t end) {
+            G4G_TRACE_SCOPE("swr::rasterizeBin");
+
+            size_t binTiles = 0, binPixels = 0;
+
+            for (size_t bin = begin; bin < end; bin++)
+            {
+                int bx = (int)(bin % binsX) * BIN_SIZE, by = (int)(bin / binsX) * BIN_SIZE;
+
+                for (size_t job = 0; job < jobCount; job++)
+                    for (uint32_t t : binLists[job][bin])
+                        rasterizeInBin(triangles[job][t], bx, by, binTiles, binPixels);
+            }
+
+            tiles += binTiles;
+            written += binPixels;
+        });
+
+        size_t setupCount = 0;
+        for (size_t job = 0; job < jobCount; job++)
+            setupCount += triangles[job].size();
+
+        stats.triangles += triangleCount;
+        stats.setup += setupCount;
+        stats.tiles += tiles;
+        stats.pixels += written;
+    }
+
+private:
+    static uint8_t toByte(float v) { return (uint8_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); }
+
+    // clipping
+    // ------------------------------------------------------------------------
+    static constexpr int CLIP_PLANES = 7;
+
+    // signed distances, >= 0 is inside
+    float planeDistance(int plane, const glm::vec4& v) const
+    {
+        float gx = 1.0f + 2.0f * GUARD_BAND / width, gy = 1.0f + 2.0f * GUARD_BAND / height;
+
+        switch (plane)
+        {
+        case 0: return v.w - 1e-5f;   // keeps the divide by w away from 0
+        case 1: return v.z + v.w;     // near
+        case 2: return v.w - v.z;     // far
+        case 3: return gx * v.w + v.x;
+        case 4: return gx * v.w - v.x;
+        case 5: return gy * v.w + v.y;
+        default: return gy * v.w - v.y;
+        }
+    }
+
+    ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t) const
+    {
+        ClipVertex r;
+        r.clip = a.clip + (b.clip - a.clip) * t;
+        for (int k = 0; k < varyingCount; k++)
+            r.varyings[k] = a.varyings[k] + (b.varyings[k] - a.varyings[k]) * t;
+        return r;
+    }
+
+    void clipAndSetup(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, std::vector<Triangle>& out) const
+    {
+        int outsideAny = 0, outsideAll = (1 << CLIP_PLANES) - 1;
+        const ClipVertex* v[3] = { &a, &b, &c };
+
+        for (int i = 0; i < 3; i++)
+        {
+            int outside = 0;
+            for (int p = 0; p < CLIP_PLANES; p++)
+                if (planeDistance(p, v[i]->clip) < 0.0f)
+                    outside |= 1 << p;
+
+            outsideAny |= outside;
+            outsideAll &= outside;
+        }
+
+        if (outsideAll) // all three behind the same plane
+            return;
+
+        if (!outsideAny) // the usual case
+        {
+            setup(a, b, c, out);
+            return;
+        }
+
+        // Sutherland-Hodgman against the planes that cut the triangle
+        ClipVertex polygon[2][3 + CLIP_PLANES];
+        int count = 3, current = 0;
+        polygon[0][0] = a;
+        polygon[0][1] = b;
+        polygon[0][2] = c;
+
+        for (int p = 0; p < CLIP_PLANES && count >= 3; p++)
+        {
+            if (!(outsideAny & (1 << p)))
+                continue;
+
+            const ClipVertex* in = polygon[current];
+            ClipVertex* result = polygon[current ^ 1];
+            int n = 0;
+
+            for (int i = 0; i < count; i++)
+            {
+                const ClipVertex& s = in[i];
+                const ClipVertex& e = in[(i + 1) % count];
+                float ds = planeDistance(p, s.clip), de = planeDistance(p, e.clip);
+
+                if (ds >= 0.0f)
+                    result[n++] = s;
+                if ((ds >= 0.0f) != (de >= 0.0f))
+                    result[n++] = lerp(s, e, ds / (ds - de));
+            }
+
+            count = n;
+            current ^= 1;
+        }
+
+        for (int i = 1; i + 1 < count; i++)
+            setup(polygon[current][0], polygon[current][i], polygon[current][i + 1], out);
+    }
+
+    // triangle setup
+    // ------------------------------------------------------------------------
+    void setup(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, std::vector<Triangle>& out) const
+    {
+        const ClipVertex* v[3] = { &a, &b, &c };
+        int64_t X[3], Y[3];
+        float invW[3], z[3];
+
+        for (int i = 0; i < 3; i++)
+        {
+            invW[i] = 1.0f / v[i]->clip.w;
+            glm::vec3 ndc = glm::vec3(v[i]->clip) * invW[i];
+            z[i] = ndc.z;
+
+            // snap to the subpixel grid, y goes down the image
+            X[i] = (int64_t)std::llround((ndc.x * 0.5 + 0.5) * width * SUBPIXEL);
+            Y[i] = (int64_t)std::llround((0.5 - ndc.y * 0.5) * height * SUBPIXEL);
+        }
+
+        // twice the signed area, negative for counter clockwise triangles since y is flipped
+        int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+
+        if (area == 0 || (cullBackFaces && area > 0))
+            return;
+
+        int order[3] = { 0, 1, 2 };
+        if (area > 0) // make the edge functions positive inside
+            std::swap(order[1], order[2]);
+
+        Triangle t;
+
+        for (int e = 0; e < 3; e++)
+        {
+            int i = order[(e + 1) % 3], j = order[(e + 2) % 3];
+
+            t.A[e] = Y[j] - Y[i];
+            t.B[e] = X[i] - X[j];
+            t.C[e] = X[j] * Y[i] - X[i] * Y[j];
+
+            // pixels exactly on an edge belong to top edges and left edges only
+            bool topLeft = t.A[e] < 0 || (t.A[e] == 0 && t.B[e] < 0);
+            t.bias[e] = topLeft ? 0 : 1;
+        }
+
+        int64_t minX = std::min({ X[0], X[1], X[2] }), maxX = std::max({ X[0], X[1], X[2] });
+        int64_t minY = std::min({ Y[0], Y[1], Y[2] }), maxY = std::max({ Y[0], Y[1], Y[2] });
+
+        // pixels whose centers can be inside
+        t.minX = (int)std::max<int64_t>(0, (minX - SUBPIXEL / 2 + SUBPIXEL - 1) >> SUBPIXEL_BITS);
+        t.minY = (int)std::max<int64_t>(0, (minY - SUBPIXEL / 2 + SUBPIXEL - 1) >> SUBPIXEL_BITS);
+        t.maxX = (int)std::min<int64_t>(width - 1, (maxX - SUBPIXEL / 2) >> SUBPIXEL_BITS);
+        t.maxY = (int)std::min<int64_t>(height - 1, (maxY - SUBPIXEL / 2) >> SUBPIXEL_BITS);
+
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+
+        // screen space plane equations through the snapped positions, anything divided by w is linear on screen
+        double x[3], y[3];
+        for (int i = 0; i < 3; i++)
+        {
+            x[i] = (double)X[i] / SUBPIXEL;
+            y[i] = (double)Y[i] / SUBPIXEL;
+        }
+
+        double det = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        t.x0 = (float)x[0];
+        t.y0 = (float)y[0];
+
+        auto plane = [&](double f0, double f1, double f2) {
+            Plane p;
+            p.base = (float)f0;
+            p.dx = (float)(((f1 - f0) * (y[2] - y[0]) - (f2 - f0) * (y[1] - y[0])) / det);
+            p.dy = (float)(((f2 - f0) * (x[1] - x[0]) - (f1 - f0) * (x[2] - x[0])) / det);
+            return p;
+        };
+
+        t.z = plane(z[0], z[1], z[2]);
+        t.invW = plane(invW[0], invW[1], invW[2]);
+
+        for (int k = 0; k < varyingCount; k++)
+            t.varyings[k] = plane(a.varyings[k] * invW[0], b.varyings[k] * invW[1], c.varyings[k] * invW[2]);
+
+        out.push_back(t);
+    }
+
+    // true if the edge functions put the whole pixel rectangle outside the triangle
+    static bool rejects(const Triangle& t, int x0, int y0, int size)
+    {
+        int64_t px = (int64_t)x0 * SUBPIXEL + SUBPIXEL / 2, py = (int64_t)y0 * SUBPIXEL + SUBPIXEL / 2;
+        int64_t span = (int64_t)(size - 1) * SUBPIXEL;
+
+        for (int e = 0; e < 3; e++)
+        {
+            int64_t value = t.A[e] * px + t.B[e] * py + t.C[e] - t.bias[e];
+            int64_t maxValue = value + std::max<int64_t>(0, t.A[e] * span) + std::max<int64_t>(0, t.B[e] * span);
+
+            if (maxValue < 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    void binTriangle(const Triangle& t, uint32_t index, std::vector<std::vector<uint32_t>>& bins) const
+    {
+        int bx0 = t.minX / BIN_SIZE, bx1 = t.maxX / BIN_SIZE;
+        int by0 = t.minY / BIN_SIZE, by1 = t.maxY / BIN_SIZE;
+
+        for (int by = by0; by <= by1; by++)
+            for (int bx = bx0; bx <= bx1; bx++)
+                if ((bx0 == bx1 && by0 == by1) || !rejects(t, bx * BIN_SIZE, by * BIN_SIZE, BIN_SIZE))
+                    bins[(size_t)by * binsX + bx].push_back(index);
+    }
+
+    // raster stage
+    // ------------------------------------------------------------------------
+    void rasterizeInBin(const Triangle& t, int binX, int binY, size_t& tileCount, size_t& pixelCount)
+    {
+        int x0 = std::max(t.minX, binX) & ~(TILE_SIZE - 1), x1 = std::min(t.maxX, binX + BIN_SIZE - 1);
+        int y0 = std::max(t.minY, binY) & ~(TILE_SIZE - 1), y1 = std::min(t.maxY, binY + BIN_SIZE - 1);
+
+        for (int ty = y0; ty <= y1; ty += TILE_SIZE)
+            for (int tx = x0; tx <= x1; tx += TILE_SIZE)
+            {
+                tileCount++;
+                pixelCount += rasterizeTile(t, tx, ty);
+            }
+    }
+
+    size_t rasterizeTile(const Triangle& t, int tx, int ty)
+    {
+        // classify the tile against every edge, edges it lies completely inside of need no per pixel test
+        int64_t px = (int64_t)tx * SUBPIXEL + SUBPIXEL / 2, py = (int64_t)ty * SUBPIXEL + SUBPIXEL / 2;
+        const int64_t span = (TILE_SIZE - 1) * SUBPIXEL;
+
+        int partial = 0;
+        int32_t rowValue[3], stepX[3], stepY[3];
+
+        for (int e = 0; e < 3; e++)
+        {
+            int64_t value = t.A[e] * px + t.B[e] * py + t.C[e] - t.bias[e];
+            int64_t dx = t.A[e] * span, dy = t.B[e] * span;
+            int64_t minValue = value + std::min<int64_t>(0, dx) + std::min<int64_t>(0, dy);
+            int64_t maxValue = value + std::max<int64_t>(0, dx) + std::max<int64_t>(0, dy);
+
+            if (maxValue < 0)
+                return 0;
+
+            if (minValue >= 0)
+                continue;
+
+            // the edge crosses this tile, so its values here are small enough for 32 bits
+            rowValue[partial] = (int32_t)value;
+            stepX[partial] = (int32_t)(t.A[e] * SUBPIXEL);
+            stepY[partial] = (int32_t)(t.B[e] * SUBPIXEL);
+            partial++;
+        }
+
+        I8 edge[3], edgeStepY[3];
+        for (int e = 0; e < partial; e++)
+        {
+            edge[e] = set1(rowValue[e]) + lanes(stepX[e]);
+            edgeStepY[e] = set1(stepY[e]);
+        }
+
+        // planes at the tile's first pixel center
+        double cx = tx + 0.5, cy = ty + 0.5;
+        F8 z = set1((float)t.z.at(cx, cy, t.x0, t.y0)) + lanes(t.z.dx), zStep = set1(t.z.dy);
+        F8 invW = set1((float)t.invW.at(cx, cy, t.x0, t.y0)) + lanes(t.invW.dx), invWStep = set1(t.invW.dy);
+
+        F8 vary[MAX_VARYINGS], varyStep[MAX_VARYINGS];
+        for (int k = 0; k < varyingCount; k++)
+        {
+            vary[k] = set1((float)t.varyings[k].at(cx, cy, t.x0, t.y0)) + lanes(t.varyings[k].dx);
+            varyStep[k] = set1(t.varyings[k].dy);
+        }
+
+        int columns = std::min(TILE_SIZE, width - tx), rows = std::min(TILE_SIZE, height - ty);
+        int columnMask = (1 << columns) - 1;
+        const I8 minusOne = set1(-1);
+
+        size_t written = 0;
+
+        for (int row = 0; row < rows; row++)
+        {
+            int y = ty + row;
+
+            I8 inside = set1(-1);
+            for (int e = 0; e < partial; e++)
+                inside = inside & (edge[e] > minusOne);
+
+            int mask = movemask(inside) & columnMask;
+
+            if (mask)
+            {
+                float* depthRow = &depth[(size_t)y * depthStride + tx];
+                F8 stored = load(depthRow);
+
+                if (depthTest)
+                {
+                    I8 pass = inside & (z <= stored);
+                    mask &= movemask(pass);
+                    store(depthRow, select(pass, z, stored));
+                }
+
+                if (mask)
+                {
+                    // perspective correct varyings: interpolate v/w and 1/w, divide per pixel
+                    F8 w = set1(1.0f) / invW;
+
+                    alignas(32) float values[MAX_VARYINGS][8];
+                    for (int k = 0; k < varyingCount; k++)
+                        store(values[k], vary[k] * w);
+
+                    uint8_t* out = pixels + (size_t)y * stride + (size_t)tx * channels;
+
+                    for (int lane = 0; lane < columns; lane++)
+                    {
+                        if (!(mask & (1 << lane)))
+                            continue;
+
+                        float v[MAX_VARYINGS];
+                        for (int k = 0; k < varyingCount; k++)
+                            v[k] = values[k][lane];
+
+                        glm::vec3 color = fragmentShader ? fragmentShader(v, tx + lane, y)
+                                                         : glm::vec3(v[0], varyingCount > 1 ? v[1] : v[0], varyingCount > 2 ? v[2] : v[0]);
+
+                        uint8_t* p = out + lane * channels;
+                        p[0] = toByte(color.r);
+                        p[1] = toByte(color.g);
+                        p[2] = toByte(color.b);
+                        written++;
+                    }
+                }
+            }
+
+            for (int e = 0; e < partial; e++)
+                edge[e] = edge[e] + edgeStepY[e];
+
+            z = z + zStep;
+            invW = invW + invWStep;
+            for (int k = 0; k < varyingCount; k++)
+                vary[k] = vary[k] + varyStep[k];
+        }
+
+        return written;
+    }
+};
+
+}
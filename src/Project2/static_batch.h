@@ -0,0 +1,213 @@
+#include "renderer.h"
+
+#include <map>
+#include <vector>
+
+#pragma once
+// layout of one entry in the GL_DRAW_INDIRECT_BUFFER, as defined by the GL spec
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// merges the meshes of renderers that never change into one VBO/EBO per shader and draws each group
+// with a single glMultiDrawElementsIndirect
+//
+// objects opt in with add(), which marks them static batched so the regular render loop skips them.
+// every object is one indirect command with a single instance, its baseInstance picks its model matrix
+// out of a per instance attribute buffer, so the batch shader must read the matrix from locations 1-4
+// like the INSTANCED variant of data/vertex.lgsl does
+class StaticBatch {
+
+    struct Group {
+        Shader* shader = nullptr;
+        std::vector<renderer*> members;
+
+        unsigned int VAO = 0, VBO = 0, EBO = 0, matrixVBO = 0, indirectBuffer = 0;
+        std::vector<DrawElementsIndirectCommand> commands;
+    };
+
+    std::map<Shader*, Group> groups;
+    bool built = false;
+
+public: ~StaticBatch()
+{
+    clear();
+}
+
+    // objects are drawn with batchShader (an instanced variant of their own shader) while in the batch
+public: void add(renderer* r, Shader* batchShader)
+{
+    Group& g = groups[batchShader];
+    g.shader = batchShader;
+    g.members.push_back(r);
+
+    r->setStaticBatched(true);
+    built = false;
+}
+
+    // hand all objects back to the per object path and free the merged buffers
+public: void clear()
+{
+    for (auto& entry : groups)
+    {
+        for (renderer* r : entry.second.members)
+            r->setStaticBatched(false);
+
+        releaseBuffers(entry.second);
+    }
+
+    groups.clear();
+    built = false;
+}
+
+public: size_t size() const
+{
+    size_t n = 0;
+    for (auto& entry : groups)
+        n += entry.second.members.size();
+    return n;
+}
+
+    // merge vertex/index data and capture the model matrices, called automatically before the first draw after add()
+public: void build()
+{
+    for (auto& entry : groups)
+    {
+        Group& g = entry.second;
+
+        releaseBuffers(g);
+
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<glm::mat4> matrices;
+
+        g.commands.clear();
+
+        for (renderer* r : g.members)
+        {
+            DrawElementsIndirectCommand cmd;
+            cmd.count = (unsigned int)r->getMeshIndices().size();
+            cmd.instanceCount = 1;
+            cmd.firstIndex = (unsigned int)indices.size();
+            cmd.baseVertex = (int)(vertices.size() / 3);
+            cmd.baseInstance = (unsigned int)matrices.size();
+            g.commands.push_back(cmd);
+
+            vertices.insert(vertices.end(), r->getMeshVertices().begin(), r->getMeshVertices().end());
+            indices.insert(indices.end(), r->getMeshIndices().begin(), r->getMeshIndices().end());
+            matrices.push_back(r->getModelMatrix());
+        }
+
+        glGenVertexArrays(1, &g.VAO);
+        glGenBuffers(1, &g.VBO);
+        glGenBuffers(1, &g.EBO);
+        glGenBuffers(1, &g.matrixVBO);
+        glGenBuffers(1, &g.indirectBuffer);
+
+        glBindVertexArray(g.VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, g.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, g.matrixVBO);
+        glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(glm::mat4), matrices.data(), GL_STATIC_DRAW);
+
+        setMatrixAttributes(0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glBindVertexArray(0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g.indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, g.commands.size() * sizeof(DrawElementsIndirectCommand), g.commands.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    built = true;
+}
+
+public: void render(const glm::mat4& vMat, const glm::mat4& pMat)
+{
+    if (!built)
+        build();
+
+    glm::mat4 identity(1.0f);
+
+    for (auto& entry : groups)
+    {
+        Group& g = entry.second;
+
+        if (g.commands.empty() || !g.shader->ready())
+            continue;
+
+        g.shader->use();
+
+        // the per object matrices come from the instance buffer, the batch itself sits at the origin
+        glUniformMatrix4fv(g.shader->uniformLocation(Shader::UNIFORM_M), 1, GL_FALSE, glm::value_ptr(identity));
+
+        renderer::setCameraUniforms(g.shader, vMat, pMat);
+
+        glBindVertexArray(g.VAO);
+
+        if (GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance)
+        {
+            // the whole group in one call
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g.indirectBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)g.commands.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            // GL 4.1 (macOS) ignores baseInstance, so walk the commands and point the matrix attribute at each object
+            glBindBuffer(GL_ARRAY_BUFFER, g.matrixVBO);
+
+            for (const DrawElementsIndirectCommand& cmd : g.commands)
+            {
+                setMatrixAttributes(cmd.baseInstance * sizeof(glm::mat4));
+                glDrawElementsBaseVertex(GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT, (void*)(cmd.firstIndex * sizeof(unsigned int)), cmd.baseVertex);
+            }
+
+            setMatrixAttributes(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    glBindVertexArray(0);
+}
+
+private:
+    // model matrix attribute at locations 1-4, read once per instance starting at offset bytes into the bound GL_ARRAY_BUFFER
+    static void setMatrixAttributes(size_t offset)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(1 + i);
+            glVertexAttribDivisor(1 + i, 1);
+        }
+    }
+
+    static void releaseBuffers(Group& g)
+    {
+        if (!g.VAO)
+            return;
+
+        glDeleteBuffers(1, &g.indirectBuffer);
+        glDeleteBuffers(1, &g.matrixVBO);
+        glDeleteBuffers(1, &g.EBO);
+        glDeleteBuffers(1, &g.VBO);
+        glDeleteVertexArrays(1, &g.VAO);
+
+        g.VAO = g.VBO = g.EBO = g.matrixVBO = g.indirectBuffer = 0;
+    }
+};
@@ -0,0 +1,275 @@
+#include <glad/glad.h>
+
+#include "image_file.h"
+#include "job_system.h"
+#include "mpsc_queue.h"
+#include "ring_buffer.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma once
+// loads image files into textures without ever making the GL thread wait for a disk read or a decode
+//
+//   TextureLoader::Handle h = loader.load("data/brick1.jpg");
+//   ...every frame: loader.update(streamBuffer); then bind loader.texture(h)
+//
+// the file is read and decoded (loadImageFile) as a job on the job system, the pixels come back to the GL
+// thread through a lock-free queue. update() uploads them in strips of rows through the frame's region of the
+// streaming buffer (so the copies are asynchronous), at most uploadBudget bytes per frame, then builds the mipmaps.
+// until an image is complete texture() returns a shared placeholder, so a level asking for hundreds of textures
+// starts drawing at once and they pop in over the following frames
+class TextureLoader {
+
+public:
+    typedef uint32_t Handle;
+
+    enum class State { Decoding, Uploading, Ready, Failed };
+
+    size_t uploadBudget = 4 * 1024 * 1024; // bytes per update()
+
+private:
+    struct Entry {
+        std::string path;
+        unsigned int texture = 0; // 0 until the first strip is uploaded
+        State state = State::Decoding;
+        int width = 0, height = 0, channels = 0;
+    };
+
+    // made by a worker, owned by the GL thread once popped
+    struct Decoded {
+        Handle handle = 0;
+        DecodedImage image;
+        int rowsUploaded = 0;
+    };
+
+    std::vector<Entry> entries;
+    MpscQueue<Decoded*> decoded;
+    std::deque<std::unique_ptr<Decoded>> uploads;
+    std::atomic<int> inFlight{ 0 }; // jobs still running, for the destructor
+    int pending = 0;                // GL thread: loaded but not popped off the queue yet
+    unsigned int placeholder = 0;
+    bool flipVertically;
+
+public:
+    // flipVertically: the first image row ends up at t = 1, the way GL texture coordinates expect it
+    explicit TextureLoader(bool flip = true) : flipVertically(flip)
+    {
+        // grey checker, obviously not a real texture but not an eyesore either
+        const uint8_t pixels[4 * 4] = { 96, 96, 96, 255, 160, 160, 160, 255, 160, 160, 160, 255, 96, 96, 96, 255 };
+
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    ~TextureLoader()
+    {
+        // jobs still running would push into a dead queue, help them finish
+        while (inFlight > 0)
+        {
+            if (!JobSystem::instance().runPendingJob())
+                std::this_thread::yield();
+        }
+
+        Decoded* d;
+        while (decoded.pop(d))
+            delete d;
+
+        for (Entry& e : entries)
+            if (e.texture)
+                glDeleteTextures(1, &e.texture);
+
+        glDeleteTextures(1, &placeholder);
+    }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // GL thread, returns right away
+    Handle load(const std::string& path)
+    {
+        Handle h = (Handle)entries.size();
+        entries.emplace_back();
+        entries.back().path = path;
+
+        inFlight++;
+        pending++;
+
+        JobSystem::instance().submit([this, h, path] {
+            decoded.push(decode(h, path).release());
+            inFlight--;
+        });
+
+        return h;
+    }
+
+    // the texture to bind for h, the placeholder until it is Ready
+    unsigned int texture(Handle h) const
+    {
+        return entries[h].state == State::Ready ? entries[h].texture : placeholder;
+    }
+
+    State state(Handle h) const { return entries[h].state; }
+    bool ready(Handle h) const { return entries[h].state == State::Ready; }
+    int width(Handle h) const { return entries[h].width; }
+    int height(Handle h) const { return entries[h].height; }
+    const std::string& path(Handle h) const { return entries[h].path; }
+    size_t size() const { return entries.size(); }
+
+    // images still being read/decoded (or decoded and waiting for update() to pick them up) and still being uploaded.
+    // counted on the GL thread, an image stays in decoding() until update() pops it, so calling update() while
+    // either is non-zero never strands one
+    int decoding() const { return pending; }
+    size_t uploading() const { return uploads.size(); }
+
+    // GL thread once per frame, after ring.beginFrame()
+    void update(RingBuffer& ring)
+    {
+        G4G_TRACE_SCOPE("TextureLoader::update");
+
+        Decoded* popped;
+        while (decoded.pop(popped))
+        {
+            std::unique_ptr<Decoded> d(popped);
+            Entry& e = entries[d->handle];
+            pending--;
+
+            if (!d->image)
+            {
+                e.state = State::Failed;
+                std::cout << "ERROR::TEXTURE::LOAD_FAILED " << e.path << ": " << imageLoadErrorName(d->image.error) << " ("
+                    << d->image.reason << ")" << std::endl;
+                continue;
+            }
+
+            e.state = State::Uploading;
+            e.width = d->image.width;
+            e.height = d->image.height;
+            e.channels = d->image.channels;
+            uploads.push_back(std::move(d));
+        }
+
+        size_t budget = uploadBudget;
+
+        while (!uploads.empty() && budget > 0)
+        {
+            Decoded& d = *uploads.front();
+
+            if (!uploadRows(d, ring, budget))
+                break; // out of budget (or ring space) for this frame
+
+            finish(entries[d.handle]);
+            uploads.pop_front();
+        }
+    }
+
+private:
+    std::unique_ptr<Decoded> decode(Handle h, const std::string& path)
+    {
+        G4G_TRACE_SCOPE("TextureLoader::decode");
+
+        std::unique_ptr<Decoded> d = std::make_unique<Decoded>();
+        d->handle = h;
+
+        // not flipped here, uploadRows flips while it copies the rows anyway
+        d->image = loadImageFile(path);
+
+        return d;
+    }
+
+    struct Formats {
+        GLint internalFormat;
+        GLenum format;
+    };
+
+    static Formats formats(int channels)
+    {
+        static const Formats table[] = { { GL_R8, GL_RED }, { GL_RG8, GL_RG }, { GL_RGB8, GL_RGB }, { GL_RGBA8, GL_RGBA } };
+        return table[channels - 1];
+    }
+
+    // uploads as many rows of d as the budget allows, true once all of them are on the GPU
+    bool uploadRows(Decoded& d, RingBuffer& ring, size_t& budget)
+    {
+        Entry& e = entries[d.handle];
+        const DecodedImage& image = d.image;
+        Formats f = formats(image.channels);
+
+        size_t srcRow = image.rowBytes();
+        size_t row = (srcRow + 3) & ~(size_t)3; // GL_UNPACK_ALIGNMENT 4
+
+        if (!e.texture)
+        {
+            glGenTextures(1, &e.texture);
+            glBindTexture(GL_TEXTURE_2D, e.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, f.internalFormat, image.width, image.height, 0, f.format, GL_UNSIGNED_BYTE, NULL);
+        }
+        else
+            glBindTexture(GL_TEXTURE_2D, e.texture);
+
+        while (d.rowsUploaded < image.height)
+        {
+            // at least one row per frame, so huge images still make progress
+            int rows = std::min<int>(image.height - d.rowsUploaded, (int)std::max<size_t>(budget / row, 1));
+
+            RingBuffer::Allocation a = ring.allocate(row * rows);
+            if (!a)
+                return false; // the ring grows for the next frame
+
+            // GL row y is image row y, or height - 1 - y when flipping
+            uint8_t* dst = (uint8_t*)a.ptr;
+            for (int i = 0; i < rows; i++)
+            {
+                int y = d.rowsUploaded + i;
+                int src = flipVertically ? image.height - 1 - y : y;
+                memcpy(dst + i * row, image.row(src), srcRow);
+            }
+
+            ring.flush(a);
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, a.buffer);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, d.rowsUploaded, image.width, rows, f.format, GL_UNSIGNED_BYTE, (const void*)a.offset);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            d.rowsUploaded += rows;
+            budget -= std::min(budget, row * rows);
+
+            if (budget == 0 && d.rowsUploaded < image.height)
+                return false;
+        }
+
+        return true;
+    }
+
+    void finish(Entry& e)
+    {
+        glBindTexture(GL_TEXTURE_2D, e.texture);
+
+        // grey (+ alpha) images read as grey rather than red (+ green)
+        if (e.channels <= 2)
+        {
+            GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, e.channels == 2 ? GL_GREEN : GL_ONE };
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        e.state = State::Ready;
+    }
+};
@@ -0,0 +1,128 @@
+#include <glad/glad.h>
+
+#include "dirty_tiles.h"
+#include "image.h"
+#include "ring_buffer.h"
+#include "trace.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#pragma once
+// sends only the changed tiles of a CPU image to its texture, through the frame's region of the streaming buffer
+//
+// each dirty rectangle is copied into the ring buffer and handed to glTexSubImage2D with that buffer bound as the
+// pixel unpack buffer, so the call returns right away and the transfer happens on the GPU's schedule (the ring's
+// fences keep the CPU from overwriting it early). if the ring is out of room this frame the rectangle goes straight
+// from client memory instead and the ring grows for the next frame.
+// mipmaps are only rebuilt when they are used (mipmaps = true) and something was uploaded
+class TileUploader {
+
+    std::vector<uint8_t> scratch; // tiled images when the ring is full
+
+public:
+    bool mipmaps = false;
+
+    // last upload
+    size_t tiles = 0, rects = 0, bytes = 0;
+
+    struct Formats {
+        GLint internalFormat;
+        GLenum format, type;
+    };
+
+    static Formats formats(PixelFormat f)
+    {
+        static const Formats table[] = {
+            { GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE },
+            { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+            { GL_R32F, GL_RED, GL_FLOAT },
+            { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT },
+        };
+        return table[(int)f];
+    }
+
+    // (re)creates the level 0 storage for an image of this size and format, the pixels follow through upload()
+    static void allocate(unsigned int texture, const Image& image)
+    {
+        Formats f = formats(image.format());
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, f.internalFormat, image.width(), image.height(), 0, f.format, f.type, NULL);
+    }
+
+    // texture has to have storage for image (allocate), call after ring.beginFrame()
+    void upload(unsigned int texture, Image& image, DirtyTiles& dirty, RingBuffer& ring)
+    {
+        G4G_TRACE_SCOPE("TileUploader::upload");
+
+        tiles = rects = bytes = 0;
+
+        if (!dirty.any())
+            return;
+
+        Formats f = formats(image.format());
+        size_t bpp = image.pixelBytes();
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        for (const DirtyTiles::Rect& r : dirty.rects())
+        {
+            // rows padded to 4 bytes, so the default GL_UNPACK_ALIGNMENT holds for RGB8 as well
+            size_t row = ((size_t)r.width * bpp + 3) & ~(size_t)3;
+
+            RingBuffer::Allocation a = ring.allocate(row * r.height);
+
+            if (a || !image.linear())
+            {
+                // the ring's region, or CPU memory when it is full (tiled pixels still have to be gathered)
+                uint8_t* dst = (uint8_t*)a.ptr;
+                if (!a)
+                {
+                    scratch.resize(row * r.height);
+                    dst = scratch.data();
+                }
+
+                if (image.linear())
+                {
+                    for (int y = 0; y < r.height; y++)
+                        memcpy(dst + y * row, image.pixel(r.x, r.y + y), r.width * bpp);
+                }
+                else
+                {
+                    for (int y = 0; y < r.height; y++)
+                        for (int x = 0; x < r.width; x++)
+                            memcpy(dst + y * row + x * bpp, image.pixel(r.x + x, r.y + y), bpp);
+                }
+
+                if (a)
+                {
+                    ring.flush(a);
+
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, a.buffer);
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, f.format, f.type, (const void*)a.offset);
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                }
+                else
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, f.format, f.type, dst);
+            }
+            else
+            {
+                // Linear rows are a whole number of pixels apart, GL reads them in place
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(image.pitch() / bpp));
+                glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, f.format, f.type, image.pixel(r.x, r.y));
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            }
+
+            rects++;
+            bytes += (size_t)r.width * r.height * bpp;
+        }
+
+        if (mipmaps)
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+        tiles = dirty.dirtyCount();
+        dirty.clear();
+    }
+};
@@ -0,0 +1,170 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#pragma once
+// hot path CPU instrumentation, dumped on demand as Chrome trace event JSON (chrome://tracing, ui.perfetto.dev)
+//
+//   G4G_TRACE_SCOPE("name");      times the enclosing block
+//   G4G_TRACE_FUNCTION();          same, named after the function
+//   G4G_TRACE_THREAD_NAME("name"); label the calling thread in the viewer
+//
+// every thread records into its own fixed size ring buffer (single writer, no locks, no allocation after the first
+// event), old events are overwritten so the buffers always hold the most recent history.
+// without G4G_TRACE defined (cmake -DG4G_TRACE=OFF) the macros compile to nothing
+namespace trace {
+
+struct Event {
+    const char* name; // must be a string literal (or otherwise live forever)
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+// written by its owning thread only, read by whoever dumps
+class ThreadBuffer {
+
+public:
+    static const size_t CAPACITY = 1 << 16; // events kept per thread
+
+    Event events[CAPACITY];
+    std::atomic<uint64_t> head{ 0 }; // total events ever written
+    uint32_t threadId = 0;
+    std::string threadName;
+
+    void record(const char* name, uint64_t beginNs, uint64_t endNs)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+
+        events[h & (CAPACITY - 1)] = { name, beginNs, endNs };
+
+        head.store(h + 1, std::memory_order_release); // publish after the slot is written
+    }
+};
+
+struct Registry {
+    std::mutex lock; // only taken when a thread records its first event and when dumping
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+inline Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+inline uint64_t nowNs()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - start).count();
+}
+
+inline ThreadBuffer& threadBuffer()
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+
+    if (!buffer)
+    {
+        buffer = std::make_shared<ThreadBuffer>();
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        buffer->threadId = (uint32_t)r.buffers.size() + 1;
+        r.buffers.push_back(buffer); // kept alive after the thread exits so its events can still be dumped
+    }
+
+    return *buffer;
+}
+
+inline void setThreadName(const std::string& name)
+{
+    ThreadBuffer& b = threadBuffer();
+
+    std::lock_guard<std::mutex> guard(registry().lock);
+    b.threadName = name;
+}
+
+class Scope {
+    const char* name;
+    uint64_t begin;
+
+public:
+    explicit Scope(const char* n) : name(n), begin(nowNs()) {}
+    ~Scope() { threadBuffer().record(name, begin, nowNs()); }
+};
+
+// writes the events currently held by all threads as {"traceEvents": [...]}
+inline bool dumpChromeJSON(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    out << std::fixed << std::setprecision(3); // microseconds with ns resolution
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+
+    auto separator = [&]() -> std::ofstream& {
+        if (!first)
+            out << ",\n";
+        first = false;
+        return out;
+    };
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    std::vector<Event> copy;
+
+    for (auto& b : r.buffers)
+    {
+        if (!b->threadName.empty())
+            separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->threadId
+                        << ",\"args\":{\"name\":\"" << b->threadName << "\"}}";
+
+        // copy what is there, then drop whatever the writer may have overwritten while we were copying
+        uint64_t end = b->head.load(std::memory_order_acquire);
+        uint64_t begin = end > ThreadBuffer::CAPACITY ? end - ThreadBuffer::CAPACITY : 0;
+
+        copy.clear();
+        for (uint64_t i = begin; i < end; i++)
+            copy.push_back(b->events[i & (ThreadBuffer::CAPACITY - 1)]);
+
+        // the writer can be in the middle of slot 'after', which is the same slot as after - CAPACITY
+        uint64_t after = b->head.load(std::memory_order_acquire);
+        uint64_t valid = after + 1 > ThreadBuffer::CAPACITY ? after + 1 - ThreadBuffer::CAPACITY : 0;
+
+        for (uint64_t i = begin; i < end; i++)
+        {
+            if (i < valid)
+                continue;
+
+            const Event& e = copy[i - begin];
+            separator() << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->threadId
+                        << ",\"ts\":" << e.beginNs / 1000.0 << ",\"dur\":" << (e.endNs - e.beginNs) / 1000.0 << "}";
+        }
+    }
+
+    out << "\n]}\n";
+    return (bool)out;
+}
+
+}
+
+#ifdef G4G_TRACE
+#define G4G_TRACE_CONCAT2(a, b) a##b
+#define G4G_TRACE_CONCAT(a, b) G4G_TRACE_CONCAT2(a, b)
+#define G4G_TRACE_SCOPE(name) trace::Scope G4G_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define G4G_TRACE_FUNCTION() G4G_TRACE_SCOPE(__func__)
+#define G4G_TRACE_THREAD_NAME(name) trace::setThreadName(name)
+#else
+#define G4G_TRACE_SCOPE(name) ((void)0)
+#define G4G_TRACE_FUNCTION() ((void)0)
+#define G4G_TRACE_THREAD_NAME(name) ((void)0)
+#endif
@@ -0,0 +1,83 @@
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#pragma once
+// parent/child transform nodes with cached world matrices
+//
+// nodes live in flat arrays (structure of arrays) and a parent is always created before its children,
+// so one forward sweep over the arrays visits every parent before anything below it.
+// update() only recomputes the world matrix of nodes that were edited or have an edited ancestor,
+// everything else keeps last frame's matrix
+class TransformHierarchy {
+
+    std::vector<int> parents;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint8_t> dirty;        // local matrix edited since the last update
+    std::vector<uint8_t> changed;      // world matrix recomputed by the last update (scratch for the sweep)
+    std::vector<unsigned int> versions; // bumped whenever the world matrix changes
+
+public:
+    unsigned int updatedCount = 0; // world matrices recomputed by the last update()
+
+    // returns the new node's index, parent must be -1 (root) or an existing node
+    int createNode(int parent = -1, const glm::mat4& local = glm::mat4(1.0f))
+    {
+        int index = (int)parents.size();
+
+        parents.push_back(parent < index ? parent : -1);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(1);
+        changed.push_back(0);
+        versions.push_back(0);
+
+        return index;
+    }
+
+    int size() const { return (int)parents.size(); }
+    int parent(int node) const { return parents[node]; }
+
+    const glm::mat4& local(int node) const { return locals[node]; }
+    const glm::mat4& world(int node) const { return worlds[node]; }
+    unsigned int version(int node) const { return versions[node]; }
+
+    void setLocal(int node, const glm::mat4& m)
+    {
+        locals[node] = m;
+        dirty[node] = 1;
+    }
+
+    // for in place edits (renderer::translate etc.), marks the node dirty
+    glm::mat4& editLocal(int node)
+    {
+        dirty[node] = 1;
+        return locals[node];
+    }
+
+    void update()
+    {
+        updatedCount = 0;
+
+        const int count = (int)parents.size();
+
+        for (int i = 0; i < count; i++)
+        {
+            int p = parents[i];
+            bool parentChanged = p >= 0 && changed[p];
+
+            if (dirty[i] || parentChanged)
+            {
+                worlds[i] = p >= 0 ? worlds[p] * locals[i] : locals[i];
+                versions[i]++;
+                changed[i] = 1;
+                dirty[i] = 0;
+                updatedCount++;
+            }
+            else
+                changed[i] = 0;
+        }
+    }
+};
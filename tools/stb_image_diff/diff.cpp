@@ -0,0 +1,187 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// decodes every file with the stb_image.h from before the SIMD and inflate work and with the current one and checks
+// that both give the same bytes: 8 bit at every requested channel count, 16 bit PNG output, and every SIMD tier of
+// the current decoder. then the same for N copies of the files with random bits flipped (and half of them cut
+// short), where both have to fail together or give the same bytes. build it with run.sh, which adds ASan.
+// with --time N it only times both decoders instead (best of N runs), run.sh builds a second copy at -O2 for that
+extern "C" {
+unsigned char* decode_ref(const unsigned char* data, int len, int* x, int* y, int* channels, int req);
+unsigned short* decode16_ref(const unsigned char* data, int len, int* x, int* y, int* channels, int req);
+void free_ref(void* p);
+unsigned char* decode_new(const unsigned char* data, int len, int* x, int* y, int* channels, int req);
+unsigned short* decode16_new(const unsigned char* data, int len, int* x, int* y, int* channels, int req);
+void free_new(void* p);
+int limit_jpeg(int tier);
+int limit_png(int tier);
+}
+
+typedef std::vector<unsigned char> Bytes;
+
+// "" if the two decodes agree, otherwise what differs
+template <typename T>
+static std::string compare(const Bytes& data, int req,
+                           T* (*ref)(const unsigned char*, int, int*, int*, int*, int),
+                           T* (*cur)(const unsigned char*, int, int*, int*, int*, int))
+{
+    int x0 = 0, y0 = 0, c0 = 0, x1 = 0, y1 = 0, c1 = 0;
+    T* a = ref(data.data(), (int)data.size(), &x0, &y0, &c0, req);
+    T* b = cur(data.data(), (int)data.size(), &x1, &y1, &c1, req);
+
+    std::string result;
+    if (!a != !b)
+        result = a ? "only the old decoder succeeded" : "only the new decoder succeeded";
+    else if (a && (x0 != x1 || y0 != y1 || c0 != c1))
+        result = "different size or channel count";
+    else if (a && memcmp(a, b, (size_t)x0 * y0 * (req ? req : c0) * sizeof(T)))
+        result = "different pixels";
+
+    free_ref(a);
+    free_new(b);
+    return result;
+}
+
+static bool isPng(const Bytes& data)
+{
+    return data.size() >= 8 && !memcmp(data.data(), "\x89PNG\r\n\x1a\n", 8);
+}
+
+// every check on one buffer, prints and counts the failures
+static int check(const Bytes& data, const std::string& name, bool allTiers)
+{
+    int failures = 0;
+    for (int tier = allTiers ? 0 : 2; tier <= 2; tier++)
+    {
+        int jpegTier = limit_jpeg(tier), pngTier = limit_png(tier);
+        if (tier > 0 && jpegTier < tier && pngTier < tier)
+            break; // the CPU (or the build) has nothing faster
+
+        for (int req = 0; req <= 4; req++)
+        {
+            std::string what = compare<unsigned char>(data, req, decode_ref, decode_new);
+            if (isPng(data) && (req == 0 || req == 4) && what.empty())
+                what = compare<unsigned short>(data, req, decode16_ref, decode16_new);
+            if (!what.empty())
+            {
+                printf("%s: tier %d, %d channels: %s\n", name.c_str(), tier, req, what.c_str());
+                failures++;
+            }
+        }
+    }
+    limit_jpeg(2);
+    limit_png(2);
+    return failures;
+}
+
+// best of runs decodes in ms, -1 if the file doesn't decode
+static double decodeTime(const Bytes& data, int runs,
+                         unsigned char* (*decode)(const unsigned char*, int, int*, int*, int*, int), void (*release)(void*))
+{
+    double best = -1.0;
+    for (int i = 0; i < runs; i++)
+    {
+        int x, y, channels;
+        auto start = std::chrono::steady_clock::now();
+        unsigned char* pixels = decode(data.data(), (int)data.size(), &x, &y, &channels, 0);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!pixels)
+            return -1.0;
+        release(pixels);
+        if (best < 0.0 || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    int fuzzCount = 0, timeRuns = 0;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--fuzz") && i + 1 < argc)
+            fuzzCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--time") && i + 1 < argc)
+            timeRuns = atoi(argv[++i]);
+        else
+            paths.push_back(argv[i]);
+    }
+    if (paths.empty())
+    {
+        printf("usage: %s [--fuzz N | --time N] image...\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Bytes> files;
+    for (const std::string& path : paths)
+    {
+        std::ifstream in(path, std::ios::binary);
+        files.push_back(Bytes(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+        if (!in && files.back().empty())
+        {
+            printf("can't read %s\n", path.c_str());
+            return 2;
+        }
+    }
+
+    // the inflate changes have no tier switch, so the old decoder is the only thing to time them against
+    if (timeRuns > 0)
+    {
+        printf("best of %d, ms         old      new\n", timeRuns);
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            double ref = decodeTime(files[i], timeRuns, decode_ref, free_ref);
+            double cur = decodeTime(files[i], timeRuns, decode_new, free_new);
+            if (ref < 0.0 || cur < 0.0)
+                printf("%s: doesn't decode\n", paths[i].c_str());
+            else
+                printf("%-20s %8.2f %8.2f  (%.2fx)\n", paths[i].substr(paths[i].find_last_of("/\\") + 1).c_str(), ref, cur, ref / cur);
+        }
+        return 0;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < files.size(); i++)
+        failures += check(files[i], paths[i], true);
+    printf("%d files, %d failures\n", (int)files.size(), failures);
+
+    // the first 8 bytes stay intact so the flipped copies still reach the decoder they came from
+    std::mt19937 random(7);
+    int fuzzFailures = 0;
+    for (int i = 0; i < fuzzCount; i++)
+    {
+        size_t source = i % files.size();
+        Bytes data = files[source];
+        if (data.size() <= 16)
+            continue;
+        if (i % 2)
+            data.resize(9 + random() % (data.size() - 9));
+        for (int flips = 1 + random() % 8; flips > 0; flips--)
+            data[8 + random() % (data.size() - 8)] ^= 1 << (random() % 8);
+
+        int found = check(data, paths[source] + " flipped #" + std::to_string(i), false);
+        if (found)
+        {
+            std::string dump = "fuzz_" + std::to_string(i) + ".bin";
+            if (FILE* out = fopen(dump.c_str(), "wb"))
+            {
+                fwrite(data.data(), 1, data.size(), out);
+                fclose(out);
+                printf("  saved as %s\n", dump.c_str());
+            }
+        }
+        fuzzFailures += found;
+    }
+    if (fuzzCount)
+        printf("%d fuzz inputs, %d failures\n", fuzzCount, fuzzFailures);
+
+    return failures || fuzzFailures ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+# writes PNG and JPEG variants of one source image for diff.cpp: every PNG filter type (one at a time and mixed) at
+# 8 and 16 bits, odd widths, Adam7 interlacing, several zlib levels and strategies, palettes and 1 bit images, and
+# JPEGs with each chroma subsampling, progressive, grayscale, restart markers and odd sizes
+#   python3 gen_images.py source.jpg outdir/
+import zlib, struct, random, os, sys
+from PIL import Image
+random.seed(7)
+out=os.path.join(sys.argv[2],'')
+os.makedirs(out,exist_ok=True)
+def chunk(t,d): return struct.pack('>I',len(d))+t+d+struct.pack('>I',zlib.crc32(t+d)&0xffffffff)
+def paeth(a,b,c):
+    p=a+b-c; pa=abs(p-a); pb=abs(p-b); pc=abs(p-c)
+    if pa<=pb and pa<=pc: return a
+    if pb<=pc: return b
+    return c
+def encode(name, w, h, rows, bpp, colortype, depth, filt, level=6, strategy=zlib.Z_DEFAULT_STRATEGY):
+    raw=bytearray(); prev=bytes(len(rows[0]))
+    for y,r in enumerate(rows):
+        f = filt if filt>=0 else random.randrange(5)
+        o=bytearray(len(r))
+        for i in range(len(r)):
+            a = r[i-bpp] if i>=bpp else 0
+            b = prev[i]; c = prev[i-bpp] if i>=bpp else 0
+            p = [0,a,b,(a+b)>>1,paeth(a,b,c)][f]
+            o[i]=(r[i]-p)&255
+        raw.append(f); raw+=o; prev=r
+    co=zlib.compressobj(level,zlib.DEFLATED,15,9,strategy)
+    z=co.compress(bytes(raw))+co.flush()
+    d=b'\x89PNG\r\n\x1a\n'+chunk(b'IHDR',struct.pack('>IIBBBBB',w,h,depth,colortype,0,0,0))+chunk(b'IDAT',z)+chunk(b'IEND',b'')
+    open(out+name,'wb').write(d)
+src=Image.open(sys.argv[1]).convert('RGBA')
+for (w,h) in [(256,256),(37,19),(1,5),(601,97)]:
+    im=src.resize((w,h))
+    for mode,ct,bpp in [('RGBA',6,4),('RGB',2,3),('L',0,1),('LA',4,2)]:
+        m=im.convert(mode); data=m.tobytes(); rl=w*bpp
+        rows=[data[y*rl:(y+1)*rl] for y in range(h)]
+        for f in [-1,0,1,2,3,4]:
+            encode(f'g_{w}x{h}_{mode}_f{f}.png',w,h,rows,bpp,ct,8,f)
+    # 16 bit rgba / rgb
+    for mode,ct,ch in [('RGBA',6,4),('RGB',2,3)]:
+        m=im.convert(mode); data=m.tobytes(); rl=w*ch
+        rows=[bytes(b for v in data[y*rl:(y+1)*rl] for b in (v, (v*37)&255)) for y in range(h)]
+        for f in [-1,3,4]:
+            encode(f'g_{w}x{h}_{mode}16_f{f}.png',w,h,rows,ch*2,ct,16,f)
+# compression variants on a big image
+big=src.resize((1024,768)).convert('RGB'); data=big.tobytes(); rl=1024*3
+rows=[data[y*rl:(y+1)*rl] for y in range(768)]
+for lv in [0,1,9]:
+    encode(f'b_level{lv}.png',1024,768,rows,3,2,8,-1,lv)
+encode('b_huff.png',1024,768,rows,3,2,8,4,6,zlib.Z_HUFFMAN_ONLY)
+encode('b_rle.png',1024,768,rows,3,2,8,1,6,zlib.Z_RLE)
+encode('b_fixed.png',1024,768,rows,3,2,8,2,6,zlib.Z_FIXED)
+# pillow variants: palette, 1-bit, interlace not supported by writer
+src.convert('RGB').quantize(200).save(out+'p_pal.png')
+src.convert('1').save(out+'p_1bit.png')
+src.convert('RGBA').save(out+'p_rgba.png')
+src.convert('RGB').save(out+'p_rgb_opt.png',optimize=True)
+def encode_adam7(name, w, h, pix, bpp, colortype, filt):
+    passes=[(0,0,8,8),(4,0,8,8),(0,4,4,8),(2,0,4,4),(0,2,2,4),(1,0,2,2),(0,1,1,2)]
+    raw=bytearray()
+    for (x0,y0,dx,dy) in passes:
+        xs=list(range(x0,w,dx)); ys=list(range(y0,h,dy))
+        if not xs or not ys: continue
+        prev=bytes(len(xs)*bpp)
+        for y in ys:
+            r=b''.join(pix[(y*w+x)*bpp:(y*w+x+1)*bpp] for x in xs)
+            f = filt if filt>=0 else random.randrange(5)
+            o=bytearray(len(r))
+            for i in range(len(r)):
+                a = r[i-bpp] if i>=bpp else 0
+                b = prev[i]; c = prev[i-bpp] if i>=bpp else 0
+                p = [0,a,b,(a+b)>>1,paeth(a,b,c)][f]
+                o[i]=(r[i]-p)&255
+            raw.append(f); raw+=o; prev=r
+    z=zlib.compress(bytes(raw))
+    d=b'\x89PNG\r\n\x1a\n'+chunk(b'IHDR',struct.pack('>IIBBBBB',w,h,8,colortype,0,0,1))+chunk(b'IDAT',z)+chunk(b'IEND',b'')
+    open(out+name,'wb').write(d)
+for (w,h) in [(61,47),(3,2),(256,9)]:
+    for mode,ct,bpp in [('RGBA',6,4),('RGB',2,3)]:
+        m=src.resize((w,h)).convert(mode)
+        for f in [-1,4]:
+            encode_adam7(f'i_{w}x{h}_{mode}_f{f}.png',w,h,m.tobytes(),bpp,ct,f)
+# jpeg: pillow's subsampling 0 = 4:4:4, 1 = 4:2:2, 2 = 4:2:0
+for (w,h) in [(512,512),(37,19),(1,5),(601,97),(17,1000)]:
+    im=src.resize((w,h)).convert('RGB')
+    for sub in [0,1,2]:
+        for q in [50,95]:
+            im.save(f'{out}j_{w}x{h}_s{sub}_q{q}.jpg',quality=q,subsampling=sub)
+            im.save(f'{out}j_{w}x{h}_s{sub}_q{q}_prog.jpg',quality=q,subsampling=sub,progressive=True)
+    im.convert('L').save(f'{out}j_{w}x{h}_gray.jpg',quality=90)
+    im.convert('L').save(f'{out}j_{w}x{h}_gray_prog.jpg',quality=90,progressive=True)
+    im.convert('CMYK').save(f'{out}j_{w}x{h}_cmyk.jpg',quality=90)
+    im.save(f'{out}j_{w}x{h}_optimize.jpg',quality=85,optimize=True)
+    im.save(f'{out}j_{w}x{h}_restart.jpg',quality=85,restart_marker_blocks=3)
@@ -0,0 +1,19 @@
+// the stb_image.h in includes/, built the same way the project builds it (all tiers it compiles in)
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+unsigned char* decode_new(const unsigned char* data, int len, int* x, int* y, int* channels, int req)
+{
+    return stbi_load_from_memory(data, len, x, y, channels, req);
+}
+
+unsigned short* decode16_new(const unsigned char* data, int len, int* x, int* y, int* channels, int req)
+{
+    return stbi_load_16_from_memory(data, len, x, y, channels, req);
+}
+
+void free_new(void* p) { stbi_image_free(p); }
+
+int limit_jpeg(int tier) { return stbi_jpeg_simd_limit(tier); }
+int limit_png(int tier) { return stbi_png_simd_limit(tier); }
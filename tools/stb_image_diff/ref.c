@@ -0,0 +1,16 @@
+// the stb_image.h from before the SIMD and inflate work, run.sh takes it out of git as stb_image_ref.h
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image_ref.h"
+
+unsigned char* decode_ref(const unsigned char* data, int len, int* x, int* y, int* channels, int req)
+{
+    return stbi_load_from_memory(data, len, x, y, channels, req);
+}
+
+unsigned short* decode16_ref(const unsigned char* data, int len, int* x, int* y, int* channels, int req)
+{
+    return stbi_load_16_from_memory(data, len, x, y, channels, req);
+}
+
+void free_ref(void* p) { stbi_image_free(p); }
@@ -0,0 +1,53 @@
+#!/bin/sh
+# compares includes/stb_image.h against the stb_image.h from before the SIMD and inflate work on the files in data/,
+# on the variants gen_images.py writes (needs python3 with Pillow, skipped without it) and on FUZZ bit flipped copies
+# of all of them, under ASan. run from anywhere:
+#   tools/stb_image_diff/run.sh             (FUZZ=3000 by default)
+#   REF=<commit> FUZZ=0 tools/stb_image_diff/run.sh
+# then times both decoders on data/ at -O2 without ASan, best of TIME runs (20 by default, TIME=0 skips it)
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/../.." && pwd)
+out="$root/_stb_image_diff"
+mkdir -p "$out"
+
+# the decoder as it was vendored, before the commits that added the AVX2 tier and the faster inflate
+REF=${REF:-$(git -C "$root" rev-list --max-parents=0 HEAD)}
+# with the one fix the current decoder got along with this check: a corrupt DC size over 15 read past stbi__jbias in
+# both, which ASan stops on. the old one has to reject it too or every such file counts as a difference
+git -C "$root" show "$REF:includes/stb_image.h" |
+    sed -e 's/if (t < 0) return stbi__err("bad huffman code"/if (t < 0 || t > 15) return stbi__err("bad huffman code"/' \
+        -e 's/if (t == -1) return stbi__err("can.t merge dc and ac"/if (t < 0 || t > 15) return stbi__err("can'"'"'t merge dc and ac"/' \
+    > "$out/stb_image_ref.h"
+
+# ASan only: both versions inherit upstream's shifts of negative values and by too much on corrupt JPEGs, so UBSan
+# would stop on the first flipped copy either way
+flags="-g -O1 -fsanitize=address"
+gcc $flags -c "$here/ref.c" -I "$out" -o "$out/ref.o"
+gcc $flags -c "$here/new.c" -I "$root/includes" -o "$out/new.o"
+g++ $flags -std=c++17 "$here/diff.cpp" "$out/ref.o" "$out/new.o" -o "$out/stb_image_diff"
+
+rm -rf "$out/images"
+if python3 -c "import PIL" 2>/dev/null; then
+    python3 "$here/gen_images.py" "$root/data/brick1.jpg" "$out/images"
+else
+    echo "no Pillow, only checking the files in data/"
+    mkdir -p "$out/images"
+fi
+
+# stb leaves the parts of a truncated image it never reached uninitialized, in both versions. ASan fills every
+# allocation with the same byte so those parts compare equal instead of showing whatever the heap held before
+cd "$out"
+set -- "$root"/data/*.jpg "$root"/data/*.png "$root"/data/cubeMap/*.jpg
+for image in images/*; do
+    [ -f "$image" ] && set -- "$@" "$image"
+done
+ASAN_OPTIONS=${ASAN_OPTIONS:-max_malloc_fill_size=1073741824} ./stb_image_diff --fuzz "${FUZZ:-3000}" "$@"
+
+if [ "${TIME:-20}" -gt 0 ]; then
+    flags="-O2"
+    gcc $flags -c "$here/ref.c" -I "$out" -o "$out/ref_bench.o"
+    gcc $flags -c "$here/new.c" -I "$root/includes" -o "$out/new_bench.o"
+    g++ $flags -std=c++17 "$here/diff.cpp" "$out/ref_bench.o" "$out/new_bench.o" -o "$out/stb_image_bench"
+    ./stb_image_bench --time "${TIME:-20}" "$root"/data/*.png "$root"/data/*.jpg "$root"/data/cubeMap/*.jpg
+fi